@@ -0,0 +1,1156 @@
+// Native CPU signer for the IPL3 checksum.
+//
+// This is a CPU-only replacement for the wgpu path of ipl3hasher-new: it
+// searches the same (Y, X) space with the same checksum algorithm (see
+// ipl3hasher-new/src/cpu.rs and shaders/hasher.glsl), and finds the same
+// collisions, so it can be used on hosts without a GPU.
+//
+// For each Y, the checksum state is computed up to the last word of the IPL3
+// with a scalar loop. The X round, that tries all 2^32 values of the last
+// word, runs one X candidate per SIMD lane (16 lanes with AVX-512, 8 with
+// AVX2, 4 otherwise) on all the threads of the pool.
+//
+// Usage: ipl3sign [options] <rom>
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <bit>
+#include <array>
+#include <atomic>
+#include <map>
+#include <deque>
+#include <optional>
+#include <mutex>
+#include <thread>
+#include <filesystem>
+#include <functional>
+#include <csignal>
+#include <poll.h>
+
+// Thread pool and parallel loop primitives
+#include "thread_utils.h"
+
+// Line-based socket helpers, for the distributed workers
+#include "socket_utils.h"
+
+static const char* USAGE =
+    "Usage: ipl3sign [options] <rom>\n"
+    "\n"
+    "Options:\n"
+    "  --sign             Sign the ROM with the collision that is found\n"
+    "  --cic=NAME         CIC whose checksum must be matched (default: 6102)\n"
+    "  --checksum=HEX     Checksum to match instead of the one of the CIC\n"
+    "  --y-bits=SPEC      Y bits: 32-bit word indices and bit ranges, as in\n"
+    "                     ipl3hasher-new (eg: 40[16..8],56[24..12], default: 1022[31..0])\n"
+    "  --y-init=N         Y value to start with (default: 0)\n"
+    "  --threads=N        Number of threads (default: all hardware threads)\n"
+    "  --bench            Only measure the X round throughput on the first Y\n"
+    "  --self-test        Check the SIMD kernel against the scalar checksum\n"
+    "  --journal=FILE     Record the searched Y values in FILE, and skip those\n"
+    "                     already recorded there (to resume an interrupted run)\n"
+    "  --lease=N          Y values handed out to a worker at a time (default: 16)\n"
+    "  --listen=ADDR      Also hand out leases to workers connecting to ADDR\n"
+    "                     (unix:PATH or HOST:PORT; :PORT is loopback only,\n"
+    "                     *:PORT all interfaces; not authenticated)\n"
+    "  --serve-only       With --listen, don't search in this process\n"
+    "  --connect=ADDR     Run as a worker of the coordinator at ADDR\n";
+
+// -----------------------------------------------------------------------------
+// SCALAR CHECKSUM (reference, as in ipl3hasher-new/src/cpu.rs)
+// -----------------------------------------------------------------------------
+
+const uint32_t MAGIC = 0x6C078965;
+const int IPL3_WORDS = 1008;
+const int IPL3_OFFSET = 64;             // Offset of the IPL3 in the ROM
+const uint64_t CHECKSUM_BITS = 48;      // Bits of the checksum that must match
+
+typedef std::array<uint32_t, 16> State;
+typedef std::array<uint32_t, IPL3_WORDS> Ipl3;
+
+static inline uint32_t rol(uint32_t a, uint32_t s) { return std::rotl(a, int(s)); }
+static inline uint32_t ror(uint32_t a, uint32_t s) { return std::rotr(a, int(s)); }
+
+// The "sum" of the checksum: difference of the two halves of a 64-bit product.
+static inline uint32_t csum(uint32_t a0, uint32_t a1, uint32_t a2) {
+    uint64_t prod = uint64_t(a0) * (a1 == 0 ? a2 : a1);
+    uint32_t diff = uint32_t(prod >> 32) - uint32_t(prod);
+    return diff == 0 ? a0 : diff;
+}
+
+// Step i of the checksum, over the word i-1. As in cpu.rs, the last step
+// doesn't update the second half of the state (that looks ahead to the next
+// word).
+static inline void step(const Ipl3& ipl3, State& state, uint32_t i, bool last) {
+    uint32_t prev = ipl3[i >= 2 ? i - 2 : 0];
+    uint32_t data = ipl3[i - 1];
+
+    state[0] += csum(1007 - i, data, i);
+    state[1] = csum(state[1], data, i);
+    state[2] ^= data;
+    state[3] += csum(data + 5, MAGIC, i);
+    state[4] += ror(data, prev & 0x1F);
+    state[5] += rol(data, prev >> 27);
+    state[6] = data < state[6] ? (state[3] + state[6]) ^ (data + i)
+                               : (state[4] + data) ^ state[6];
+    state[7] = csum(state[7], rol(data, prev & 0x1F), i);
+    state[8] = csum(state[8], ror(data, prev >> 27), i);
+    state[9] = prev < data ? csum(state[9], data, i) : state[9] + data;
+
+    if (last)
+        return;
+
+    uint32_t next = ipl3[i];
+    state[10] = csum(state[10] + data, next, i);
+    state[11] = csum(state[11] ^ data, next, i);
+    state[12] += state[8] ^ data;
+    state[13] += ror(data, data & 0x1F) + ror(next, next & 0x1F);
+    state[14] = csum(csum(state[14], ror(data, prev & 0x1F), i), ror(next, data & 0x1F), i);
+    state[15] = csum(csum(state[15], rol(data, prev >> 27), i), rol(next, data >> 27), i);
+}
+
+// Run the steps [begin, end] of the checksum; the whole IPL3 up to the word
+// end-1 if begin is 1.
+static void calculate(const Ipl3& ipl3, State& state, uint32_t begin, uint32_t end) {
+    end = std::min<uint32_t>(end, IPL3_WORDS);
+    for (uint32_t i = begin; i <= end; i++)
+        step(ipl3, state, i, i == end);
+}
+
+static uint64_t finalize(const State& state) {
+    uint32_t buf[4] = {state[0], state[0], state[0], state[0]};
+    for (uint32_t i = 0; i < 16; i++) {
+        uint32_t data = state[i];
+        buf[0] += ror(data, data & 0x1F);
+        buf[1] = data < buf[0] ? buf[1] + data : csum(buf[1], data, i);
+        buf[2] = ((data & 0x02) >> 1) == (data & 0x01) ? buf[2] + data : csum(buf[2], data, i);
+        buf[3] = (data & 0x01) ? buf[3] ^ data : csum(buf[3], data, i);
+    }
+    uint32_t final_sum = csum(buf[0], buf[1], 16);
+    uint32_t final_xor = buf[3] ^ buf[2];
+    return (uint64_t(final_sum & 0xFFFF) << 32) | final_xor;
+}
+
+// The IPL3 of a ROM and the initial checksum state for a CIC seed.
+//
+// The steps before the first word with a Y bit are the same for all Y values,
+// so their state is computed once by cachePrefix(), and each Y only re-runs
+// the steps from that word on.
+struct Checksum {
+    Ipl3 ipl3;
+    State state;
+    State prefix;                       // State after the steps [1, prefixSteps]
+    uint32_t prefixSteps = 0;
+
+    Checksum(const uint8_t* raw, uint8_t seed) {
+        for (int i = 0; i < IPL3_WORDS; i++)
+            ipl3[i] = (uint32_t(raw[i*4]) << 24) | (raw[i*4+1] << 16) | (raw[i*4+2] << 8) | raw[i*4+3];
+        state.fill((MAGIC * seed + 1) ^ ipl3[0]);
+        prefix = state;
+    }
+
+    // Compute the state up to the first word with a Y bit. Step i reads the
+    // words i-2, i-1 and i, so the steps before that word don't depend on Y.
+    void cachePrefix(const std::vector<uint32_t>& y_bits) {
+        uint32_t first = *std::min_element(y_bits.begin(), y_bits.end()) / 32;
+        prefix = state;
+        prefixSteps = first > 0 ? first - 1 : 0;
+        for (uint32_t i = 1; i <= prefixSteps; i++)
+            step(ipl3, prefix, i, false);
+    }
+
+    // Number of steps re-run for each Y value.
+    uint32_t stepsPerY() const { return 1007 - prefixSteps; }
+
+    // Copy of the IPL3 with the Y bits set to the value y (the first Y bit is
+    // the most significant one).
+    Ipl3 applyYBits(const std::vector<uint32_t>& y_bits, uint32_t y) const {
+        Ipl3 words = ipl3;
+        for (size_t i = 0; i < y_bits.size(); i++) {
+            uint32_t index = y_bits[i] / 32;
+            uint32_t bit = 31 - y_bits[i] % 32;
+            uint32_t value = (y >> (y_bits.size() - 1 - i)) & 1;
+            words[index] = (words[index] & ~(1u << bit)) | (value << bit);
+        }
+        return words;
+    }
+
+    // State of the checksum before the X round of a Y value, with the part of
+    // the last step that doesn't depend on X precomputed (as the GPU expects).
+    // Returns the last word before X.
+    uint32_t yRound(const std::vector<uint32_t>& y_bits, uint32_t y, State& out) const {
+        Ipl3 words = applyYBits(y_bits, y);
+        out = prefix;
+        calculate(words, out, prefixSteps + 1, 1007);
+
+        uint32_t prev = words[1005];
+        uint32_t data = words[1006];
+        out[10] += data;
+        out[11] ^= data;
+        out[12] += out[8] ^ data;
+        out[13] += ror(data, data & 0x1F);
+        out[14] = csum(out[14], ror(data, prev & 0x1F), 1007);
+        out[15] = csum(out[15], rol(data, prev >> 27), 1007);
+        return data;
+    }
+
+    // Full checksum of the IPL3 with the given Y and X.
+    uint64_t verify(const std::vector<uint32_t>& y_bits, uint32_t y, uint32_t x) const {
+        Ipl3 words = applyYBits(y_bits, y);
+        words[1007] = x;
+        State s = state;
+        calculate(words, s, 1, 1008);
+        return finalize(s);
+    }
+};
+
+// -----------------------------------------------------------------------------
+// SIMD X ROUND (as in ipl3hasher-new/src/shaders/hasher.glsl)
+// -----------------------------------------------------------------------------
+
+#if defined(__AVX512F__)
+const int LANES = 16;
+const char* SIMD_NAME = "AVX-512";
+#elif defined(__AVX2__)
+const int LANES = 8;
+const char* SIMD_NAME = "AVX2";
+#else
+const int LANES = 4;
+const char* SIMD_NAME = "128-bit";
+#endif
+
+// One X candidate per lane.
+typedef uint32_t VecU32 __attribute__((vector_size(LANES * 4)));
+typedef uint64_t VecU64 __attribute__((vector_size(LANES * 8)));
+typedef std::array<VecU32, 16> VecState;
+
+static inline VecU32 splat(uint32_t v) { return VecU32{} + v; }
+
+static inline VecU32 vror(VecU32 a, VecU32 s) { return (a >> s) | (a << ((32 - s) & 31)); }
+static inline VecU32 vrol(VecU32 a, VecU32 s) { return (a << s) | (a >> ((32 - s) & 31)); }
+
+static inline VecU32 vsum(VecU32 a0, VecU32 a1, uint32_t a2) {
+    VecU32 v1 = a1 == 0 ? splat(a2) : a1;
+    VecU64 prod = __builtin_convertvector(a0, VecU64) * __builtin_convertvector(v1, VecU64);
+    VecU32 diff = __builtin_convertvector(prod >> 32, VecU32) - __builtin_convertvector(prod, VecU32);
+    return diff == 0 ? a0 : diff;
+}
+
+static inline bool anyLane(VecU32 mask) {
+    uint64_t words[LANES / 2];
+    std::memcpy(words, &mask, sizeof(words));
+    uint64_t any = 0;
+    for (int i = 0; i < LANES / 2; i++)
+        any |= words[i];
+    return any != 0;
+}
+
+// Last step of the checksum for LANES values of X, from the state returned by
+// Checksum::yRound() and the word before X (y).
+static inline void xStates(const State& in, uint32_t y, VecU32 x, VecState& s) {
+    uint32_t yts = y >> 27, ybs = y & 0x1F;
+    for (int i = 0; i < 16; i++)
+        s[i] = splat(in[i]);
+
+    s[0] += vsum(splat(0xFFFFFFFF), x, 1008);
+    s[1] = vsum(s[1], x, 1008);
+    s[2] ^= x;
+    s[3] += vsum(x + 5, splat(MAGIC), 1008);
+    s[4] += vror(x, splat(ybs));
+    s[5] += vrol(x, splat(yts));
+    s[6] = x < s[6] ? (x + 1008) ^ (s[3] + s[6]) : s[6] ^ (s[4] + x);
+    s[7] = vsum(s[7], vrol(x, splat(ybs)), 1008);
+    s[8] = vsum(s[8], vror(x, splat(yts)), 1008);
+    s[9] = y < x ? vsum(s[9], x, 1008) : s[9] + x;
+    s[10] = vsum(s[10], x, 1007);
+    s[11] = vsum(s[11], x, 1007);
+    s[13] += vror(x, x & 0x1F);
+    s[14] = vsum(s[14], vror(x, splat(ybs)), 1007);
+    s[15] = vsum(s[15], vrol(x, splat(yts)), 1007);
+}
+
+// Upper 16 bits of the checksum of each lane.
+static inline VecU32 finalizeHi(const VecState& s) {
+    VecU32 buf0 = s[0], buf1 = s[0];
+    for (uint32_t i = 0; i < 16; i++) {
+        VecU32 data = s[i];
+        buf0 += vror(data, data & 0x1F);
+        buf1 = data < buf0 ? buf1 + data : vsum(buf1, data, i);
+    }
+    return vsum(buf0, buf1, 16) & 0xFFFF;
+}
+
+static inline State laneState(const VecState& s, int lane) {
+    State state;
+    for (int i = 0; i < 16; i++)
+        state[i] = s[i][lane];
+    return state;
+}
+
+// Set to stop the search: on CTRL+C, when a collision is found by another
+// worker, or when the coordinator has news for this worker.
+static std::atomic<bool> g_stop{false};
+
+// Search X in [start, end) for the given target checksum. Returns the first
+// matching X, or UINT64_MAX. The search stops early (returning UINT64_MAX) as
+// soon as *limit drops to start or below, ie. a lower X was already found,
+// or g_stop is set.
+static uint64_t xRound(const State& state, uint32_t y, uint64_t target,
+                       uint64_t start, uint64_t end, const std::atomic<uint64_t>* limit) {
+    VecU32 lane;
+    for (int i = 0; i < LANES; i++)
+        lane[i] = i;
+    uint32_t target_hi = uint32_t(target >> 32);
+    for (uint64_t x0 = start; x0 < end; x0 += LANES) {
+        if ((x0 & 0xFFFFF) == 0 && (limit->load(std::memory_order_relaxed) <= start ||
+                                    g_stop.load(std::memory_order_relaxed)))
+            return UINT64_MAX;
+        VecState s;
+        xStates(state, y, splat(uint32_t(x0)) + lane, s);
+        VecU32 hit = finalizeHi(s) == target_hi;
+        if (!anyLane(hit))
+            continue;
+        for (int i = 0; i < LANES; i++)
+            if (hit[i] && finalize(laneState(s, i)) == target)
+                return x0 + i;
+    }
+    return UINT64_MAX;
+}
+
+// -----------------------------------------------------------------------------
+// SIGNER
+// -----------------------------------------------------------------------------
+
+const uint64_t X_COUNT = uint64_t(1) << 32;
+const uint64_t CHUNK_SIZE = uint64_t(1) << 24;  // X values per task
+
+// Poll interval of the coordinator and the workers, to notice CTRL+C or a
+// stop request.
+const int COORDINATOR_POLL_MS = 100;
+
+typedef std::chrono::steady_clock Clock;
+
+// Run the X round of one Y on all the threads of the pool, over [0, x_end).
+// Returns the lowest matching X, or UINT64_MAX (also if stopped by g_stop).
+static uint64_t searchY(const Checksum& checksum, const std::vector<uint32_t>& y_bits,
+                        uint32_t y, uint64_t target, uint64_t x_end) {
+    State state;
+    uint32_t last = checksum.yRound(y_bits, y, state);
+    std::atomic<uint64_t> found{UINT64_MAX};
+    int chunks = int((x_end + CHUNK_SIZE - 1) / CHUNK_SIZE);
+    ThreadPool::global().parallelFor(chunks, [&](int chunk) {
+        uint64_t start = chunk * CHUNK_SIZE;
+        uint64_t x = xRound(state, last, target, start, std::min(start + CHUNK_SIZE, x_end), &found);
+        uint64_t prev = found.load();
+        while (x < prev && !found.compare_exchange_weak(prev, x)) {}
+    });
+    return found.load();
+}
+
+static std::string formatDuration(double seconds) {
+    std::ostringstream os;
+    if (seconds < 60)
+        os << std::fixed << std::setprecision(1) << seconds << "s";
+    else if (seconds < 3600)
+        os << std::fixed << std::setprecision(1) << seconds / 60 << "m";
+    else
+        os << std::fixed << std::setprecision(1) << seconds / 3600 << "h";
+    return os.str();
+}
+
+// Hashes per second, and the expected time to find a collision at that rate
+// (a random candidate matches the 48-bit checksum with probability 2^-48).
+static std::string formatRate(uint64_t hashes, double seconds) {
+    double rate = hashes / seconds;
+    std::ostringstream os;
+    os << std::fixed << std::setprecision(2) << rate / 1e6 << " MH/s, expected time to sign: "
+       << formatDuration(std::ldexp(1.0, CHECKSUM_BITS) / rate);
+    return os.str();
+}
+
+// Print a whole line at once, as the coordinator and the local search both log.
+static void printLine(const std::string& line) {
+    static std::mutex mutex;
+    std::lock_guard<std::mutex> lock(mutex);
+    std::cout << line << std::endl;
+}
+
+// Set the Y bits and X in the ROM file.
+static bool signRom(const std::string& path, const std::vector<uint32_t>& y_bits, uint32_t y, uint32_t x) {
+    std::fstream f(path, std::ios::in | std::ios::out | std::ios::binary);
+    if (!f)
+        return false;
+    for (size_t i = 0; i < y_bits.size(); i++) {
+        uint32_t offset = IPL3_OFFSET + y_bits[i] / 8;
+        uint32_t bit = 7 - y_bits[i] % 8;
+        uint8_t value = (y >> (y_bits.size() - 1 - i)) & 1;
+        char byte;
+        f.seekg(offset);
+        f.read(&byte, 1);
+        byte = char((uint8_t(byte) & ~(1u << bit)) | (value << bit));
+        f.seekp(offset);
+        f.write(&byte, 1);
+    }
+    uint8_t xbytes[4] = {uint8_t(x >> 24), uint8_t(x >> 16), uint8_t(x >> 8), uint8_t(x)};
+    f.seekp(IPL3_OFFSET + (IPL3_WORDS - 1) * 4);
+    f.write((const char*)xbytes, 4);
+    return bool(f);
+}
+
+// Parse the Y bits, with the same syntax and checks as ipl3hasher-new (plus
+// single bits, eg: 40[7]). Each bit is returned as its offset in bits from the
+// start of the IPL3.
+static bool parseYBits(const std::string& spec, std::vector<uint32_t>& values) {
+    values.clear();
+    std::istringstream ss(spec);
+    std::string slice;
+    while (std::getline(ss, slice, ',')) {
+        unsigned index, end = 31, start = 0;
+        int consumed = 0;
+        if (std::sscanf(slice.c_str(), "%u[%u..%u]%n", &index, &end, &start, &consumed) == 3 &&
+            consumed == int(slice.size())) {
+            if (start > end || end >= 32) {
+                std::cerr << "Error: invalid Y bits range for index " << index << "\n";
+                return false;
+            }
+        } else if (std::sscanf(slice.c_str(), "%u[%u]%n", &index, &end, &consumed) == 2 &&
+                   consumed == int(slice.size()) && end < 32) {
+            // Single bit, as printed by mips_free_bits.py
+            start = end;
+        } else if (std::sscanf(slice.c_str(), "%u%n", &index, &consumed) != 1 || consumed != int(slice.size())) {
+            std::cerr << "Error: invalid Y bits format: " << slice << "\n";
+            return false;
+        }
+        if (index <= 16 || index >= 1023) {
+            std::cerr << "Error: invalid Y bits index: " << index << "\n";
+            return false;
+        }
+        for (unsigned i = start; i <= end; i++)
+            values.push_back((index - 16) * 32 + (31 - i));
+    }
+    std::sort(values.begin(), values.end());
+    values.erase(std::unique(values.begin(), values.end()), values.end());
+    if (values.empty() || values.size() > 32) {
+        std::cerr << "Error: invalid number of Y bits: " << values.size() << " (max: 32)\n";
+        return false;
+    }
+    return true;
+}
+
+static bool parseCic(const std::string& name, uint8_t& seed, uint64_t& checksum) {
+    static const struct { const char* names[2]; uint8_t seed; uint64_t checksum; } CICS[] = {
+        {{"6101", nullptr}, 0x3F, 0x45CC73EE317A},
+        {{"6102", "7101"},  0x3F, 0xA536C0F1D859},
+        {{"6103", "7103"},  0x78, 0x586FD4709867},
+        {{"6105", "7105"},  0x91, 0x8618A45BC2D3},
+        {{"6106", "7106"},  0x85, 0x2BBAD4E6EB74},
+        {{"8303", nullptr}, 0xDD, 0x32B294E2AB90},
+        {{"8401", nullptr}, 0xDD, 0x6EE8D9E84970},
+        {{"5167", nullptr}, 0xDD, 0x083C6C77E0B1},
+        {{"DDUS", nullptr}, 0xDE, 0x05BA2EF0A5F1},
+    };
+    for (const auto& cic : CICS) {
+        for (const char* n : cic.names) {
+            if (n && name == n) {
+                seed = cic.seed;
+                checksum = cic.checksum;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Compare the state and upper checksum bits of the SIMD kernel, starting from
+// the cached prefix, against the scalar checksum of the whole IPL3, for random
+// IPL3s, Y bits and X values.
+static bool selfTest() {
+    std::mt19937 rng(1234);
+    for (int round = 0; round < 64; round++) {
+        std::vector<uint8_t> raw(IPL3_WORDS * 4);
+        for (auto& b : raw)
+            b = uint8_t(rng());
+        Checksum checksum(raw.data(), uint8_t(rng()));
+        std::vector<uint32_t> y_bits;
+        for (int bit = 0; bit < 20; bit++)
+            y_bits.push_back(32 + rng() % ((IPL3_WORDS - 2) * 32));
+        std::sort(y_bits.begin(), y_bits.end());
+        checksum.cachePrefix(y_bits);
+        uint32_t y = rng() & ((1 << y_bits.size()) - 1);
+        State state;
+        uint32_t last = checksum.yRound(y_bits, y, state);
+        for (int batch = 0; batch < 256; batch++) {
+            // Include the corner values of X, that exercise the zero checks of the sum.
+            uint32_t x0 = batch == 0 ? 0 : batch == 1 ? uint32_t(-LANES) : rng();
+            VecU32 x;
+            for (int i = 0; i < LANES; i++)
+                x[i] = x0 + i;
+            VecState s;
+            xStates(state, last, x, s);
+            VecU32 hi = finalizeHi(s);
+            for (int i = 0; i < LANES; i++) {
+                Ipl3 words = checksum.applyYBits(y_bits, y);
+                words[1007] = x[i];
+                State expected = checksum.state;
+                calculate(words, expected, 1, 1008);
+                uint64_t sum = finalize(expected);
+                if (laneState(s, i) != expected || hi[i] != sum >> 32 ||
+                    checksum.verify(y_bits, y, x[i]) != sum) {
+                    std::cerr << "Self-test failed: Y=" << std::hex << y << " X=" << x[i] << std::dec << "\n";
+                    return false;
+                }
+            }
+        }
+    }
+    std::cout << "Self-test passed\n";
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// LEASES AND JOURNAL
+// -----------------------------------------------------------------------------
+
+// Identifies what is searched: the IPL3 (without the Y bits and the X word,
+// that signing changes), the Y bits and the target checksum. A journal or a
+// worker is only valid for the same fingerprint.
+static uint64_t fingerprint(const Checksum& checksum, const std::vector<uint32_t>& y_bits, uint64_t target) {
+    Ipl3 words = checksum.applyYBits(y_bits, 0);
+    words[IPL3_WORDS - 1] = 0;
+    uint64_t hash = 0xcbf29ce484222325ull;
+    auto mix = [&](uint64_t v) {
+        for (int i = 0; i < 8; i++) {
+            hash = (hash ^ (v & 0xFF)) * 0x100000001b3ull;
+            v >>= 8;
+        }
+    };
+    for (uint32_t w : words)
+        mix(w);
+    for (uint32_t bit : y_bits)
+        mix(bit);
+    mix(target);
+    mix(checksum.state[0]);
+    return hash;
+}
+
+// The Y values still to search, handed out to the workers in leases of
+// consecutive values. Workers report each Y value they finish, so at most the
+// Y values in progress are searched again after an interruption.
+//
+// With a journal, the finished Y values and the collision are appended to it
+// as they are reported, and a later run with the same journal skips them.
+// The journal is made of text lines:
+//   IPL3SIGN <fingerprint>      first line, see fingerprint()
+//   DONE <begin> <end>          no collision for Y in [begin, end)
+//   FOUND <y> <x>               collision
+class LeaseTable {
+public:
+    struct Lease {
+        uint64_t begin, end;
+    };
+
+    enum Status { GRANTED, WAIT, FINISHED };
+
+    LeaseTable(uint64_t begin, uint64_t end, uint64_t lease_size)
+        : begin(begin), end(end), lease_size(lease_size) {}
+
+    // Load the journal at path, if it matches the fingerprint, then rewrite it
+    // compacted and keep it open to record the progress. A FOUND line is only
+    // kept if isCollision confirms it, as a line truncated by a crash can
+    // still parse.
+    bool openJournal(const std::string& path, uint64_t fp,
+                     const std::function<bool(uint64_t y, uint64_t x)>& isCollision) {
+        std::ifstream ifs(path);
+        std::string line, cmd;
+        bool matches = false;
+        if (ifs && std::getline(ifs, line)) {
+            std::istringstream ss(line);
+            uint64_t journal_fp;
+            matches = (ss >> cmd >> std::hex >> journal_fp) && cmd == "IPL3SIGN" && journal_fp == fp;
+            if (!matches)
+                printLine("Journal " + path + " does not match the ROM, starting from scratch");
+        }
+        while (matches && std::getline(ifs, line)) {
+            // A truncated last line (eg: after a crash) is ignored.
+            std::istringstream ss(line);
+            uint64_t a, b;
+            if (!(ss >> cmd >> a >> b))
+                continue;
+            if (cmd == "DONE" && a < b)
+                markDone(a, b);
+            else if (cmd == "FOUND" && isCollision(a, b))
+                found = {a, b};
+            else if (cmd == "FOUND")
+                printLine("Journal " + path + ": ignoring invalid collision Y=" + std::to_string(a) +
+                          " X=" + std::to_string(b));
+        }
+        ifs.close();
+
+        std::ostringstream os;
+        os << "IPL3SIGN " << std::hex << fp << std::dec << "\n";
+        for (const auto& [a, b] : done)
+            os << "DONE " << a << " " << b << "\n";
+        if (found)
+            os << "FOUND " << found->first << " " << found->second << "\n";
+        std::string tmp = path + ".tmp";
+        {
+            std::ofstream ofs(tmp);
+            if (!ofs || !(ofs << os.str()))
+                return false;
+        }
+        std::error_code ec;
+        std::filesystem::rename(tmp, path, ec);
+        if (ec)
+            return false;
+        journal.open(path, std::ios::app);
+        return bool(journal);
+    }
+
+    // Number of Y values in [begin, end) already searched.
+    uint64_t searched() {
+        std::lock_guard<std::mutex> lock(mutex);
+        uint64_t count = 0;
+        for (const auto& [a, b] : done) {
+            uint64_t lo = std::max(a, begin), hi = std::min(b, end);
+            count += hi > lo ? hi - lo : 0;
+        }
+        return count;
+    }
+
+    // Take the next lease. WAIT means that nothing is left to hand out, but
+    // leases are still running and may be given back.
+    Status acquire(Lease& lease) {
+        std::lock_guard<std::mutex> lock(mutex);
+        prepare();
+        if (found || g_stop.load())
+            return FINISHED;
+        if (pending.empty())
+            return running > 0 ? WAIT : FINISHED;
+        Lease& next = pending.front();
+        lease = {next.begin, std::min(next.end, next.begin + lease_size)};
+        next.begin = lease.end;
+        if (next.begin == next.end)
+            pending.pop_front();
+        running++;
+        return GRANTED;
+    }
+
+    // Record that the Y value has no collision.
+    void complete(uint64_t y) {
+        std::lock_guard<std::mutex> lock(mutex);
+        markDone(y, y + 1);
+        if (journal.is_open())
+            journal << "DONE " << y << " " << y + 1 << std::endl;
+    }
+
+    // End of a lease: the Y values from next on were not searched, and are
+    // handed out again.
+    void finish(const Lease& lease, uint64_t next) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (next < lease.end)
+            pending.push_front({next, lease.end});
+        running--;
+    }
+
+    // Record a collision, and stop all the searches.
+    void setFound(uint64_t y, uint64_t x) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (found)
+            return;
+        found = {y, x};
+        if (journal.is_open())
+            journal << "FOUND " << y << " " << x << std::endl;
+        g_stop = true;
+    }
+
+    // All the Y values are searched, or the search was stopped.
+    bool finished() {
+        std::lock_guard<std::mutex> lock(mutex);
+        prepare();
+        return found || g_stop.load() || (pending.empty() && running == 0);
+    }
+
+    bool getFound(uint64_t& y, uint64_t& x) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!found)
+            return false;
+        y = found->first;
+        x = found->second;
+        return true;
+    }
+
+private:
+    // On first use, queue the Y values that the journal doesn't list as done.
+    void prepare() {
+        if (prepared)
+            return;
+        prepared = true;
+        uint64_t y = begin;
+        for (const auto& [a, b] : done) {
+            if (a > y && y < end)
+                pending.push_back({y, std::min(a, end)});
+            y = std::max(y, b);
+        }
+        if (y < end)
+            pending.push_back({y, end});
+    }
+
+    // Add [a, b) to the done ranges, merging it with its neighbours.
+    void markDone(uint64_t a, uint64_t b) {
+        auto it = done.upper_bound(a);
+        if (it != done.begin() && std::prev(it)->second >= a) {
+            --it;
+            a = it->first;
+            b = std::max(b, it->second);
+            it = done.erase(it);
+        }
+        while (it != done.end() && it->first <= b) {
+            b = std::max(b, it->second);
+            it = done.erase(it);
+        }
+        done[a] = b;
+    }
+
+    uint64_t begin, end, lease_size;
+    std::mutex mutex;
+    std::map<uint64_t, uint64_t> done;      // Searched Y ranges, begin -> end
+    std::deque<Lease> pending;              // Y ranges still to hand out
+    bool prepared = false;
+    int running = 0;                        // Leases handed out and not finished
+    std::optional<std::pair<uint64_t, uint64_t>> found;
+    std::ofstream journal;
+};
+
+static void signalHandler(int) {
+    g_stop = true;
+}
+
+// Search the leases of the table with the threads of this process, until
+// all are done or the search is stopped.
+static void runLocal(LeaseTable& table, const Checksum& checksum,
+                     const std::vector<uint32_t>& y_bits, uint64_t target) {
+    LeaseTable::Lease lease;
+    for (;;) {
+        LeaseTable::Status status = table.acquire(lease);
+        if (status == LeaseTable::FINISHED)
+            return;
+        if (status == LeaseTable::WAIT) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(COORDINATOR_POLL_MS));
+            continue;
+        }
+        uint64_t y = lease.begin;
+        for (; y < lease.end; y++) {
+            auto start = Clock::now();
+            uint64_t x = searchY(checksum, y_bits, uint32_t(y), target, X_COUNT);
+            if (g_stop.load())
+                break;
+            std::chrono::duration<double> elapsed = Clock::now() - start;
+            printLine("Y=" + std::to_string(y) + " took " + formatDuration(elapsed.count()) + ", " +
+                      formatRate(x == UINT64_MAX ? X_COUNT : x + 1, elapsed.count()));
+            if (x != UINT64_MAX) {
+                table.setFound(y, x);
+                break;
+            }
+            table.complete(y);
+        }
+        table.finish(lease, y);
+    }
+}
+
+// -----------------------------------------------------------------------------
+// DISTRIBUTED WORKERS
+// -----------------------------------------------------------------------------
+
+// With --listen, the coordinator also hands out leases to worker processes
+// started with --connect (on this or other machines, with the same ROM and
+// options). The protocol is not authenticated: a peer that knows the
+// fingerprint (derived from the ROM) can report Y values as searched, and they
+// are recorded in the journal. So only listen on trusted networks (without a
+// host, --listen=:PORT only accepts local connections, see socket_utils.h).
+// The protocol is made of text lines:
+//   worker -> coordinator   HELLO <fingerprint>
+//   coordinator -> worker   LEASE <begin> <end>     search Y in [begin, end)
+//   worker -> coordinator   DONE <y>                no collision for Y
+//   worker -> coordinator   FOUND <y> <x>           collision (ends the lease)
+//   coordinator -> worker   QUIT, or ERROR <message>
+// Workers search the Y values of a lease in order, and are given a new lease
+// when they have reported all of them. The coordinator verifies collisions
+// before accepting them, and sends QUIT to everybody once one is found. The
+// Y values of a lost worker that it didn't report are handed out again.
+
+// Worker side: search the leases assigned by the coordinator on fd until told
+// to quit. Returns the process exit code.
+static int runWorker(int fd, uint64_t fp, const Checksum& checksum,
+                     const std::vector<uint32_t>& y_bits, uint64_t target) {
+    char hello[64];
+    snprintf(hello, sizeof(hello), "HELLO %016llx", (unsigned long long)fp);
+    if (!sendLine(fd, hello))
+        return EXIT_FAILURE;
+    std::string buffer, line;
+    for (;;) {
+        while (!nextLine(buffer, line)) {
+            if (!receive(fd, buffer, true)) {
+                // Only QUIT ends the work cleanly.
+                std::cerr << "ipl3sign: lost the connection to the coordinator\n";
+                return EXIT_FAILURE;
+            }
+        }
+        std::istringstream ss(line);
+        std::string cmd;
+        ss >> cmd;
+        uint64_t begin, end;
+        if (cmd == "LEASE" && ss >> begin >> end) {
+            // The coordinator only talks to a busy worker to stop it, so any
+            // data arriving during the search interrupts it.
+            std::atomic<bool> searching{true};
+            std::thread watcher([&]() {
+                pollfd pfd{fd, POLLIN, 0};
+                while (searching.load()) {
+                    if (poll(&pfd, 1, COORDINATOR_POLL_MS) > 0) {
+                        g_stop = true;
+                        return;
+                    }
+                }
+            });
+            bool ok = true;
+            for (uint64_t y = begin; y < end && ok && !g_stop.load(); y++) {
+                auto start = Clock::now();
+                uint64_t x = searchY(checksum, y_bits, uint32_t(y), target, X_COUNT);
+                if (g_stop.load())
+                    break;
+                std::chrono::duration<double> elapsed = Clock::now() - start;
+                printLine("Y=" + std::to_string(y) + " took " + formatDuration(elapsed.count()) + ", " +
+                          formatRate(x == UINT64_MAX ? X_COUNT : x + 1, elapsed.count()));
+                if (x != UINT64_MAX) {
+                    ok = sendLine(fd, "FOUND " + std::to_string(y) + " " + std::to_string(x));
+                    break;
+                }
+                ok = sendLine(fd, "DONE " + std::to_string(y));
+            }
+            searching = false;
+            watcher.join();
+            g_stop = false;
+            if (!ok)
+                return EXIT_FAILURE;
+        } else if (cmd == "QUIT") {
+            return EXIT_SUCCESS;
+        } else {
+            std::cerr << "ipl3sign: coordinator: " << line << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+}
+
+// Coordinator side: hands out the leases of the table to remote workers.
+struct Coordinator {
+    struct Worker {
+        int fd;
+        std::string buffer{};       // Data received and not parsed yet
+        bool ready = false;         // Handshake done
+        bool busy = false;          // Searching lease
+        LeaseTable::Lease lease{};
+        uint64_t next = 0;          // Next Y of the lease to be reported
+    };
+
+    LeaseTable& table;
+    const Checksum& checksum;
+    const std::vector<uint32_t>& y_bits;
+    uint64_t target;
+    uint64_t fp;
+    int listener;
+    std::vector<Worker> workers{};
+
+    // Disconnect a worker, giving back the rest of its lease.
+    void drop(Worker& w) {
+        if (w.busy) {
+            printLine("Lost a worker, handing out Y=" + std::to_string(w.next) + ".." +
+                      std::to_string(w.lease.end - 1) + " again");
+            table.finish(w.lease, w.next);
+        }
+        close(w.fd);
+        w.fd = -1;
+        w.busy = false;
+    }
+
+    // Handle a line from a worker. Returns false on protocol errors.
+    bool handle(Worker& w, const std::string& line) {
+        std::istringstream ss(line);
+        std::string cmd;
+        ss >> cmd;
+        uint64_t y, x;
+        if (cmd == "HELLO" && !w.ready) {
+            uint64_t worker_fp;
+            if (!(ss >> std::hex >> worker_fp) || worker_fp != fp) {
+                sendLine(w.fd, "ERROR different ROM or options");
+                return false;
+            }
+            w.ready = true;
+            return true;
+        }
+        if (cmd == "DONE" && w.busy && ss >> y && y == w.next) {
+            table.complete(y);
+            if (++w.next == w.lease.end) {
+                table.finish(w.lease, w.next);
+                w.busy = false;
+            }
+            return true;
+        }
+        if (cmd == "FOUND" && w.busy && ss >> y >> x && y == w.next && x < X_COUNT &&
+            checksum.verify(y_bits, uint32_t(y), uint32_t(x)) == target) {
+            table.setFound(y, x);
+            table.finish(w.lease, y);
+            w.busy = false;
+            return true;
+        }
+        return false;
+    }
+
+    // Serve the workers until all the leases are done or the search is stopped,
+    // then tell them to quit.
+    void run() {
+        std::vector<pollfd> fds;
+        for (;;) {
+            workers.erase(std::remove_if(workers.begin(), workers.end(),
+                                         [](const Worker& w) { return w.fd < 0; }), workers.end());
+            for (Worker& w : workers) {
+                if (!w.ready || w.busy || table.acquire(w.lease) != LeaseTable::GRANTED)
+                    continue;
+                w.busy = true;
+                w.next = w.lease.begin;
+                if (!sendLine(w.fd, "LEASE " + std::to_string(w.lease.begin) + " " + std::to_string(w.lease.end)))
+                    drop(w);
+            }
+            if (table.finished())
+                break;
+
+            fds.clear();
+            for (const Worker& w : workers)
+                fds.push_back(pollfd{w.fd, POLLIN, 0});
+            fds.push_back(pollfd{listener, POLLIN, 0});
+            if (poll(fds.data(), fds.size(), COORDINATOR_POLL_MS) <= 0)
+                continue;
+            size_t count = workers.size();
+            for (size_t i = 0; i < count; i++) {
+                Worker& w = workers[i];
+                if (w.fd < 0 || !fds[i].revents)
+                    continue;
+                bool ok = receive(w.fd, w.buffer, false);
+                std::string line;
+                while (ok && nextLine(w.buffer, line))
+                    ok = handle(w, line);
+                if (!ok)
+                    drop(w);
+            }
+            if (fds.back().revents) {
+                int fd = accept(listener, nullptr, nullptr);
+                if (fd >= 0) {
+                    workers.push_back(Worker{fd});
+                    printLine("A worker joined (" + std::to_string(workers.size()) + " connected)");
+                }
+            }
+        }
+        for (Worker& w : workers) {
+            if (w.busy)
+                table.finish(w.lease, w.next);
+            sendLine(w.fd, "QUIT");
+            close(w.fd);
+        }
+        workers.clear();
+        close(listener);
+    }
+};
+
+int main(int argc, char** argv) {
+    bool sign = false, bench = false, self_test = false;
+    std::string cic = "6102";
+    std::string checksum_override;
+    std::string y_bits_spec = "1022[31..0]";
+    uint64_t y = 0;
+    uint64_t lease_size = 16;
+    std::string journal_file, listen_address, connect_address;
+    bool serve_only = false;
+    int argIndex = 1;
+    while (argIndex < argc && std::string(argv[argIndex]).rfind("--", 0) == 0) {
+        std::string arg = argv[argIndex];
+        if (arg == "--sign") {
+            sign = true;
+        } else if (arg.rfind("--cic=", 0) == 0) {
+            cic = arg.substr(6);
+        } else if (arg.rfind("--checksum=", 0) == 0) {
+            checksum_override = arg.substr(11);
+        } else if (arg.rfind("--y-bits=", 0) == 0) {
+            y_bits_spec = arg.substr(9);
+        } else if (arg.rfind("--y-init=", 0) == 0) {
+            y = std::strtoull(arg.c_str() + 9, nullptr, 0);
+        } else if (arg.rfind("--threads=", 0) == 0) {
+            int threads = std::atoi(arg.c_str() + 10);
+            if (threads < 1) {
+                std::cerr << "Error: --threads must be at least 1\n";
+                return EXIT_FAILURE;
+            }
+            ThreadPool::setGlobalSize(threads);
+        } else if (arg == "--bench") {
+            bench = true;
+        } else if (arg == "--self-test") {
+            self_test = true;
+        } else if (arg.rfind("--journal=", 0) == 0) {
+            journal_file = arg.substr(10);
+        } else if (arg.rfind("--lease=", 0) == 0) {
+            lease_size = std::strtoull(arg.c_str() + 8, nullptr, 0);
+            if (lease_size < 1) {
+                std::cerr << "Error: --lease must be at least 1\n";
+                return EXIT_FAILURE;
+            }
+        } else if (arg.rfind("--listen=", 0) == 0) {
+            listen_address = arg.substr(9);
+        } else if (arg == "--serve-only") {
+            serve_only = true;
+        } else if (arg.rfind("--connect=", 0) == 0) {
+            connect_address = arg.substr(10);
+        } else {
+            std::cerr << "Error: Unknown option: " << arg << "\n";
+            return EXIT_FAILURE;
+        }
+        argIndex++;
+    }
+
+    if (self_test)
+        return selfTest() ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    if (argc - argIndex != 1) {
+        std::cerr << USAGE;
+        return EXIT_FAILURE;
+    }
+    if (serve_only && listen_address.empty()) {
+        std::cerr << "Error: --serve-only requires --listen\n";
+        return EXIT_FAILURE;
+    }
+    std::string rom = argv[argIndex];
+
+    uint8_t seed;
+    uint64_t target;
+    if (!parseCic(cic, seed, target)) {
+        std::cerr << "Error: Unknown CIC: " << cic << "\n";
+        return EXIT_FAILURE;
+    }
+    if (!checksum_override.empty())
+        target = std::strtoull(checksum_override.c_str(), nullptr, 16) & ((uint64_t(1) << CHECKSUM_BITS) - 1);
+    std::vector<uint32_t> y_bits;
+    if (!parseYBits(y_bits_spec, y_bits))
+        return EXIT_FAILURE;
+
+    std::vector<uint8_t> raw(IPL3_WORDS * 4);
+    std::ifstream f(rom, std::ios::binary);
+    f.seekg(IPL3_OFFSET);
+    if (!f.read((char*)raw.data(), raw.size())) {
+        std::cerr << "Error: cannot read the IPL3 from " << rom << "\n";
+        return EXIT_FAILURE;
+    }
+    Checksum checksum(raw.data(), seed);
+    checksum.cachePrefix(y_bits);
+
+    std::cout << "CPU: " << ThreadPool::global().size() << " threads, " << SIMD_NAME
+              << " (" << LANES << " lanes)\n";
+    std::cout << "Target seed and checksum: 0x" << std::hex << std::uppercase << std::setfill('0')
+              << std::setw(2) << int(seed) << " 0x" << std::setw(12) << target
+              << std::dec << std::nouppercase << std::setfill(' ') << "\n";
+
+    {
+        // Cost of the part of each Y round that is not the X round.
+        const int rounds = 1000;
+        State state;
+        uint32_t sink = 0;
+        auto start = Clock::now();
+        for (int i = 0; i < rounds; i++)
+            sink += checksum.yRound(y_bits, uint32_t(y + i), state) ^ state[0];
+        std::chrono::duration<double, std::micro> elapsed = Clock::now() - start;
+        volatile uint32_t keep = sink;
+        (void)keep;
+        std::cout << "Y prefix: first Y bit in word " << checksum.prefixSteps + 1 + 16 << ", recomputing "
+                  << checksum.stepsPerY() << " of 1007 words per Y (" << std::fixed << std::setprecision(2)
+                  << elapsed.count() / rounds << " us)\n";
+    }
+
+    if (bench) {
+        // A fixed slice of the first X round, enough for a stable figure.
+        uint64_t count = CHUNK_SIZE * 4 * ThreadPool::global().size();
+        auto start = Clock::now();
+        searchY(checksum, y_bits, uint32_t(y), target, std::min(count, X_COUNT));
+        std::chrono::duration<double> elapsed = Clock::now() - start;
+        printLine(formatRate(std::min(count, X_COUNT), elapsed.count()));
+        return EXIT_SUCCESS;
+    }
+
+    uint64_t fp = fingerprint(checksum, y_bits, target);
+
+    // Worker mode: search the leases handed out by the coordinator.
+    if (!connect_address.empty()) {
+        int fd = openSocket(connect_address, false, "ipl3sign");
+        return fd < 0 ? EXIT_FAILURE : runWorker(fd, fp, checksum, y_bits, target);
+    }
+
+    LeaseTable table(y, uint64_t(1) << y_bits.size(), lease_size);
+    if (!journal_file.empty()) {
+        auto isCollision = [&](uint64_t y, uint64_t x) {
+            return y < (uint64_t(1) << y_bits.size()) && x < X_COUNT &&
+                   checksum.verify(y_bits, uint32_t(y), uint32_t(x)) == target;
+        };
+        if (!table.openJournal(journal_file, fp, isCollision)) {
+            std::cerr << "Error: cannot write journal " << journal_file << "\n";
+            return EXIT_FAILURE;
+        }
+        std::cout << "Journal: " << table.searched() << " Y values already searched\n";
+    }
+    std::signal(SIGINT, signalHandler);
+
+    // Coordinator mode: serve the remote workers from another thread, while
+    // this one searches too.
+    std::thread server;
+    std::unique_ptr<Coordinator> coordinator;
+    if (!listen_address.empty()) {
+        int listener = openSocket(listen_address, true, "ipl3sign");
+        if (listener < 0)
+            return EXIT_FAILURE;
+        coordinator.reset(new Coordinator{table, checksum, y_bits, target, fp, listener});
+        server = std::thread([&]() { coordinator->run(); });
+    }
+    if (!serve_only)
+        runLocal(table, checksum, y_bits, target);
+    if (server.joinable())
+        server.join();
+
+    uint64_t x;
+    if (table.getFound(y, x)) {
+        uint64_t verified = checksum.verify(y_bits, uint32_t(y), uint32_t(x));
+        if (verified != target) {
+            std::cerr << "Error: checksum verify failed for Y=" << y << " X=" << x << "\n";
+            return EXIT_FAILURE;
+        }
+        std::cout << "Found collision: Y=" << std::hex << std::uppercase << std::setfill('0')
+                  << std::setw(8) << y << " X=" << std::setw(8) << x << std::dec << "\n";
+        if (sign) {
+            if (!signRom(rom, y_bits, uint32_t(y), uint32_t(x))) {
+                std::cerr << "Error: cannot sign " << rom << "\n";
+                return EXIT_FAILURE;
+            }
+            std::cout << "ROM has been successfully signed\n";
+        }
+        return EXIT_SUCCESS;
+    }
+    if (g_stop.load()) {
+        std::cout << "Interrupted" << (journal_file.empty() ? "\n" : ", run again with the same --journal to resume\n");
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "Sorry nothing\n";
+    return EXIT_FAILURE;
+}
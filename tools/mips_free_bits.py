@@ -6,12 +6,17 @@ This tool scans a flat binary file of 32-bit big-endian MIPS IV instructions,
 identifies reserved ("free") bits in each opcode, and reports their locations.
 
 Usage:
-    python3 mips_free_bits_tool.py [-v|--verbose] [--base OFFSET] [--limit N] <filename>
+    python3 mips_free_bits_tool.py [-v|--verbose] [--base OFFSET] [--limit N] [--from-end] <filename>
 
 Options:
     -v, --verbose   Print a summary table of opcode counts and free-bit totals.
     --base OFFSET   Byte-index base for reporting (decimal or hex, default=0).
     --limit N       Maximum number of free bits to report in the list (default: no limit).
+    --from-end      Pick the free bits closest to the end of the IPL3 instead of
+                    the first ones, and print the estimated per-Y signing cost.
+
+The IPL3 checksum state must be recomputed for every Y value from the first
+word holding a Y bit, so Y bits near the end of the IPL3 make signing cheaper.
 """
 
 import argparse
@@ -61,6 +66,11 @@ OPCODE_FREE_BITS = {
     (0x11, 0x06): list(range(0, 11)),   # ctc1
 }
 
+# The IPL3 spans the words [16, 1024) of the ROM; its last word holds the X
+# bits of the signer, so Y bits must come before it.
+IPL3_X_WORD = 1023
+IPL3_END_WORD = 1024
+
 # Human-readable mnemonics for verbose mode
 OPCODE_MNEMONICS = {
     (0x00, 0x04): 'sllv',  (0x00, 0x06): 'srlv',  (0x00, 0x07): 'srav',
@@ -87,6 +97,8 @@ def parse_args():
     parser.add_argument('--base', default='0', help='Base offset (decimal or hex)')
     parser.add_argument('--skip', default='0', help='How many bytes to skip at the beginning')
     parser.add_argument('--limit', type=int, help='Maximum number of free bits to report')
+    parser.add_argument('--from-end', action='store_true',
+                        help='Pick the free bits closest to the end of the IPL3')
     return parser.parse_args()
 
 
@@ -167,14 +179,25 @@ def main():
             print(f"{mnem:<10} {stats['count']:>8} {stats['free_bits']:>10}")
         print(f"Total free bits: {total_free}\n")
 
-    # Flatten and apply limit
+    # Flatten and apply limit. With --from-end, the bits are ranked by their
+    # distance from the end of the IPL3, skipping the X word and what follows.
     flat_bits = []
-    for byte_idx in sorted(free_bits_global):
+    word_order = sorted(free_bits_global, reverse=args.from_end)
+    for byte_idx in word_order:
+        if args.from_end and byte_idx >= IPL3_X_WORD:
+            continue
         for bit in sorted(free_bits_global[byte_idx]):
             flat_bits.append((byte_idx, bit))
     if args.limit is not None:
         flat_bits = flat_bits[:args.limit]
 
+    # The signer caches the checksum state up to the first word with a Y bit,
+    # and recomputes the rest of the IPL3 for every Y value.
+    if args.from_end and flat_bits:
+        first = min(word_idx for word_idx, _ in flat_bits)
+        print(f"Estimated per-Y cost: {IPL3_END_WORD - first} of {IPL3_END_WORD - 17} words "
+              f"(first Y bit in word {first})", file=sys.stderr)
+
     # Group by byte for output ranges
     grouped = {}
     for word_idx, bit in flat_bits:
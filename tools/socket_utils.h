@@ -0,0 +1,134 @@
+#ifndef SOCKET_UTILS_H
+#define SOCKET_UTILS_H
+
+#include <iostream>
+#include <string>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+
+// Stream sockets carrying text lines, used by the tools that distribute their
+// work to other processes. Addresses are either a Unix domain socket
+// ("unix:PATH") or TCP ("HOST:PORT").
+//
+// The protocols are not authenticated: any peer that can connect can take part
+// in the work and report results. So a listening socket without a host
+// (":PORT") is bound to the loopback interface (127.0.0.1), and listening on
+// other interfaces needs an explicit host: an address of this machine, or "*"
+// for all of them. Only do so on a trusted network.
+
+// Create a socket bound to (listen) or connected to the given address.
+// Returns the file descriptor, or -1 with an error message (prefixed by the
+// name of the tool) on failure.
+inline int openSocket(const std::string& address, bool listen, const char* tool) {
+    if (address.rfind("unix:", 0) == 0) {
+        sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        std::string path = address.substr(5);
+        if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+            std::cerr << tool << ": invalid socket path: " << address << "\n";
+            return -1;
+        }
+        memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0 && listen)
+            unlink(path.c_str());
+        if (fd >= 0 && (listen ? bind(fd, (sockaddr*)&addr, sizeof(addr)) == 0 && ::listen(fd, 16) == 0
+                               : connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0))
+            return fd;
+        std::cerr << tool << ": " << address << ": " << strerror(errno) << "\n";
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos) {
+        std::cerr << tool << ": invalid address (expected unix:PATH or HOST:PORT): " << address << "\n";
+        return -1;
+    }
+    std::string host = address.substr(0, colon), port = address.substr(colon + 1);
+    addrinfo hints = {}, *res;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    // With AI_PASSIVE, a null host is all the interfaces.
+    bool any = listen && host == "*";
+    if (listen && host.empty())
+        host = "127.0.0.1";
+    hints.ai_flags = any ? AI_PASSIVE : 0;
+    int err = getaddrinfo(host.empty() || any ? nullptr : host.c_str(), port.c_str(), &hints, &res);
+    if (err != 0) {
+        std::cerr << tool << ": " << address << ": " << gai_strerror(err) << "\n";
+        return -1;
+    }
+    int fd = -1;
+    for (addrinfo* ai = res; ai && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0)
+            continue;
+        int one = 1;
+        if (listen)
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        else
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if (listen ? bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && ::listen(fd, 16) == 0
+                   : connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+            break;
+        close(fd);
+        fd = -1;
+    }
+    if (fd < 0)
+        std::cerr << tool << ": " << address << ": " << strerror(errno) << "\n";
+    freeaddrinfo(res);
+    return fd;
+}
+
+// Send a whole line. Returns false if the peer is gone.
+inline bool sendLine(int fd, const std::string& line) {
+    std::string data = line + "\n";
+    for (size_t sent = 0; sent < data.size(); ) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        sent += n;
+    }
+    return true;
+}
+
+// Read the available data into buffer, waiting for it if block is set.
+// Returns false on end of stream or error.
+inline bool receive(int fd, std::string& buffer, bool block) {
+    char chunk[4096];
+    for (;;) {
+        ssize_t n = recv(fd, chunk, sizeof(chunk), block ? 0 : MSG_DONTWAIT);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && !block && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return true;
+        if (n <= 0)
+            return false;
+        buffer.append(chunk, n);
+        if (block || size_t(n) < sizeof(chunk))
+            return true;
+    }
+}
+
+// Extract the next complete line from buffer, if any.
+inline bool nextLine(std::string& buffer, std::string& line) {
+    size_t end = buffer.find('\n');
+    if (end == std::string::npos)
+        return false;
+    line = buffer.substr(0, end);
+    buffer.erase(0, end + 1);
+    return true;
+}
+
+#endif
@@ -3,22 +3,35 @@
 #include <vector>
 #include <string>
 #include <sstream>
+#include <iomanip>
 #include <cstdlib>
 #include <cstdint>
 #include <unordered_map>
+#include <map>
+#include <utility>
 #include <algorithm>
 #include <random>
 #include <chrono>
 #include <cmath>
+#include <bit>
+#include <array>
 #include <thread>
 #include <mutex>
 #include <atomic>
+#include <condition_variable>
 #include <csignal>
 #include <cstring>
+#include <stdexcept>
 #include <filesystem>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <poll.h>
 #include <fcntl.h>
 #include <assert.h>
 
@@ -28,203 +41,2672 @@
 // Include ELFIO (header-only)
 #include "elfio/elfio.hpp"
 
-// Simplified thread map primitive
+// Thread pool and parallel loop primitives
 #include "thread_utils.h"
 
+// Line-based socket helpers, for the distributed workers
+#include "socket_utils.h"
+
 namespace fs = std::filesystem;
 
-// -----------------------------------------------------------------------------
-// GLOBAL VARIABLES AND CONSTANTS
-// -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+// GLOBAL VARIABLES AND CONSTANTS
+// -----------------------------------------------------------------------------
+
+// Fixed load address when building the flat binary.
+const uint32_t LOAD_ADDRESS = 0x80000000;
+
+// Other addresses and alignment of the stages, as in small.1.ld.
+const uint32_t IMEM_ADDRESS = 0xA4001000;       // Stage 1
+const uint32_t UNCACHED_ADDRESS = 0xA0000000;   // Uncached view of RDRAM, for .text.stage2u
+const uint32_t STAGE_ALIGNMENT = 8;             // Stages are padded to a multiple of 8 bytes
+
+// A constant representing failure.
+const double MAX_COST = std::numeric_limits<double>::infinity();
+
+// Global constants for gp-relative rule:
+const uint32_t GP_RELATIVE_MAX_OFFSET = 65536;    // They must be fully contained within the first 65536 bytes.
+const uint32_t GP_OFFSET = 0x8000;                // _gp points 32 KiB after the start of the sections.
+
+// Runs of zeros longer than this are folded before compression (see foldZeroRuns).
+const uint32_t ZERO_RUN_LIMIT = 64;
+
+// Fragments of split sections are at least this large (see splitSections).
+const uint32_t FRAGMENT_MIN_SIZE = 64;
+// Default cap on the number of fragments added by --split.
+const int DEFAULT_MAX_FRAGMENTS = 64;
+
+// Global flag for graceful termination (CTRL+C).
+std::atomic<bool> g_stop{false};
+void signalHandler(int signum) {
+    g_stop.store(true);
+}
+
+// -----------------------------------------------------------------------------
+// DATA STRUCTURE: Candidate Section
+// -----------------------------------------------------------------------------
+
+// MIPS relocation types handled when building the image.
+const uint32_t R_MIPS_32 = 2;
+const uint32_t R_MIPS_26 = 4;
+const uint32_t R_MIPS_HI16 = 5;
+const uint32_t R_MIPS_LO16 = 6;
+const uint32_t R_MIPS_GPREL16 = 7;
+
+// Special relocation targets (see Relocation::target).
+const int32_t TARGET_ABSOLUTE = -1;     // Absolute symbol (or undefined)
+const int32_t TARGET_BASE = -2;         // Start of the sections (__stage2, __stage2_start)
+const int32_t TARGET_GP = -3;           // _gp
+
+// A relocation to apply to a candidate section. The symbol value S is the
+// address of the target plus target_offset and the addend, which also includes
+// the in-place addend of REL relocations (for HI16, combined with the paired LO16).
+struct Relocation {
+    uint32_t offset;            // Offset of the relocated word in the section data
+    uint32_t image_offset;      // Offset of the relocated word in the folded image
+    uint32_t type;              // R_MIPS_* type
+    int32_t target;             // Candidate index of the target section, or TARGET_*
+    int64_t target_offset;      // Offset of the symbol from the start of the target
+    int64_t addend;             // Added to the symbol address
+    // Symbol as found in the object file, resolved into target once all the
+    // candidates are known (see resolveRelocations()).
+    std::string symbol;         // Name of an undefined symbol
+    uint32_t symbol_section;    // Section index of a defined symbol in the same file
+    uint32_t symbol_value;      // Value of a defined symbol in the same file
+    bool section_symbol;        // The symbol is the section itself
+    // False for relocations that can't be applied (unsupported type, or out of
+    // the section data): they are not patched, but still keep their target
+    // alive in collectGarbage(), as they do for the --gc-sections of GNU ld.
+    bool apply;
+};
+
+// Structure representing a candidate section from an input ELF object file.
+struct SectionCandidate {
+    std::string file_name;      // The originating file (.o)
+    std::string section_name;   // Section name (e.g. ".text", ".data", ".bss", etc.)
+    uint32_t alignment;         // Required alignment (power of 2)
+    uint32_t size;              // Section size in bytes
+    std::vector<uint8_t> data;  // Section contents (for SHT_PROGBITS read from file; empty for SHT_NOBITS)
+    bool nobits;                // True for SHT_NOBITS sections (all zeros)
+    bool gp_relative;           // True if the section is GP-relative
+    std::vector<uint8_t> image; // Contents as fed to the compressor, with long zero runs folded
+    uint32_t folded_bits;       // Estimated cost in bits of the zeros folded out of image
+    uint32_t section_index;     // Index of the section in its file
+    bool big_endian;            // Byte order of the file
+    std::vector<Relocation> relocs;         // Relocations to apply to data/image
+    std::vector<uint32_t> referenced_by;    // Candidates with relocations against this one
+    uint32_t fragment_offset = 0;           // Offset in the section, for fragments of split sections
+    bool splittable = false;                // Can be split at its symbols (see splitSections())
+    std::vector<uint32_t> symbol_offsets;   // Offsets of the symbols defined in the section
+
+    // Placement rules (see checkConstraints()).
+    uint32_t region_start = 0;          // The section must start at or after this offset...
+    uint32_t region_end = UINT32_MAX;   // ...and end at or before this one.
+    int pin = -1;                       // If >= 0, required position in the ordering
+    int follows = -1;                   // If >= 0, candidate that must immediately precede this one
+};
+
+// -----------------------------------------------------------------------------
+// UTILITY FUNCTIONS
+// -----------------------------------------------------------------------------
+
+// Align an offset upward to a given alignment.
+inline uint32_t align_up(uint32_t offset, uint32_t alignment) {
+    if (alignment == 0) return offset;
+    uint32_t rem = offset % alignment;
+    return (rem == 0) ? offset : offset + (alignment - rem);
+}
+
+// Estimated cost in bits of the length of a zero run. upkr encodes a long run
+// of zeros as a single match, whose length is stored as an Elias-gamma-like code
+// taking about two bits per power of two.
+inline uint32_t zeroRunBits(uint32_t length) {
+    return 2 * std::bit_width(length);
+}
+
+// Build the compressor view of a section (image) from its contents. Runs of zeros
+// longer than ZERO_RUN_LIMIT (above all, whole .bss sections) are shortened,
+// keeping their length modulo 16 so that the alignment of the following data
+// (and thus upkr parity contexts) is unchanged. The cost of the removed zeros
+// is estimated with zeroRunBits() and stored in folded_bits. This way the
+// evaluator doesn't compress the same kilobytes of zeros on every move.
+// Relocated words are never folded, as they are patched at link time; their
+// offset in the image is stored in the relocations.
+void foldZeroRuns(SectionCandidate& cand) {
+    cand.image.clear();
+    cand.folded_bits = 0;
+    auto appendRun = [&](uint32_t length) {
+        uint32_t folded = length;
+        if (length > ZERO_RUN_LIMIT) {
+            folded = ZERO_RUN_LIMIT + (length - ZERO_RUN_LIMIT) % 16;
+            cand.folded_bits += zeroRunBits(length) - zeroRunBits(folded);
+        }
+        cand.image.insert(cand.image.end(), folded, 0);
+    };
+    if (cand.nobits) {
+        appendRun(cand.size);
+        return;
+    }
+    std::vector<bool> relocated(cand.data.size());
+    for (const Relocation& rel : cand.relocs)
+        for (size_t k = rel.offset; k < size_t(rel.offset) + 4 && k < cand.data.size(); k++)
+            relocated[k] = true;
+    std::vector<uint32_t> imageOffset(cand.data.size());
+    for (size_t i = 0; i < cand.data.size(); ) {
+        if (cand.data[i] != 0 || relocated[i]) {
+            imageOffset[i] = cand.image.size();
+            cand.image.push_back(cand.data[i++]);
+            continue;
+        }
+        size_t j = i;
+        while (j < cand.data.size() && cand.data[j] == 0 && !relocated[j])
+            j++;
+        appendRun(j - i);
+        i = j;
+    }
+    for (Relocation& rel : cand.relocs)
+        rel.image_offset = rel.offset < cand.data.size() ? imageOffset[rel.offset] : 0;
+}
+
+// -----------------------------------------------------------------------------
+// RELOCATIONS
+// -----------------------------------------------------------------------------
+
+inline uint32_t readWord(const uint8_t* p, bool big_endian) {
+    return big_endian ? (uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | p[3])
+                      : (uint32_t(p[3]) << 24 | uint32_t(p[2]) << 16 | uint32_t(p[1]) << 8 | p[0]);
+}
+
+inline void writeWord(uint8_t* p, uint32_t v, bool big_endian) {
+    for (int i = 0; i < 4; i++)
+        p[big_endian ? 3 - i : i] = uint8_t(v >> (i * 8));
+}
+
+// Read the relocations of a candidate section from its REL/RELA sections.
+// Symbols are only recorded here, and resolved by resolveRelocations().
+// Returns the number of relocations that can't be applied (unsupported types,
+// or out of the section data), which are kept only as references.
+int readRelocations(const ELFIO::elfio& reader, SectionCandidate& cand) {
+    const ELFIO::section* symtab = nullptr;
+    for (const auto& sec : reader.sections)
+        if (sec->get_type() == ELFIO::SHT_SYMTAB)
+            symtab = sec.get();
+    int unsupported = 0;
+    for (const auto& relsec : reader.sections) {
+        if ((relsec->get_type() != ELFIO::SHT_REL && relsec->get_type() != ELFIO::SHT_RELA) ||
+            relsec->get_info() != cand.section_index || !symtab)
+            continue;
+        bool rela = relsec->get_type() == ELFIO::SHT_RELA;
+        ELFIO::const_relocation_section_accessor relocs(reader, relsec.get());
+        ELFIO::const_symbol_section_accessor symbols(reader, symtab);
+        struct Entry { ELFIO::Elf64_Addr offset; ELFIO::Elf_Word symbol; unsigned type; ELFIO::Elf_Sxword addend; };
+        std::vector<Entry> entries(relocs.get_entries_num());
+        for (size_t j = 0; j < entries.size(); j++)
+            relocs.get_entry(j, entries[j].offset, entries[j].symbol, entries[j].type, entries[j].addend);
+
+        for (size_t j = 0; j < entries.size(); j++) {
+            const Entry& e = entries[j];
+            Relocation rel;
+            rel.offset = e.offset;
+            rel.image_offset = 0;
+            rel.type = e.type;
+            rel.target = TARGET_ABSOLUTE;
+            rel.target_offset = 0;
+            rel.apply = (e.type == R_MIPS_32 || e.type == R_MIPS_26 || e.type == R_MIPS_HI16 ||
+                         e.type == R_MIPS_LO16 || e.type == R_MIPS_GPREL16) &&
+                        e.offset + 4 <= cand.data.size();
+            if (!rel.apply)
+                unsupported++;
+
+            std::string name;
+            ELFIO::Elf64_Addr value;
+            ELFIO::Elf_Xword size;
+            unsigned char bind, type, other;
+            ELFIO::Elf_Half section;
+            symbols.get_symbol(e.symbol, name, value, size, bind, type, section, other);
+            rel.symbol_section = section;
+            rel.symbol_value = 0;
+            rel.section_symbol = type == ELFIO::STT_SECTION;
+            if (section == ELFIO::SHN_UNDEF)
+                rel.symbol = name;
+            else if (section != ELFIO::SHN_ABS)
+                rel.symbol_value = value;
+
+            // The addend of REL relocations is stored in the relocated field.
+            int64_t addend = e.addend;
+            if (!rela && rel.apply) {
+                uint32_t insn = readWord(&cand.data[e.offset], cand.big_endian);
+                switch (e.type) {
+                case R_MIPS_32:      addend = int32_t(insn); break;
+                case R_MIPS_26:      addend = (insn & 0x3ffffff) << 2; break;
+                case R_MIPS_LO16:
+                case R_MIPS_GPREL16: addend = int16_t(insn & 0xffff); break;
+                case R_MIPS_HI16:
+                    // The low part comes from the next LO16 against the same symbol.
+                    addend = int64_t(insn & 0xffff) << 16;
+                    for (size_t k = j + 1; k < entries.size(); k++) {
+                        if (entries[k].type == R_MIPS_LO16 && entries[k].symbol == e.symbol &&
+                            entries[k].offset + 4 <= cand.data.size()) {
+                            addend += int16_t(readWord(&cand.data[entries[k].offset], cand.big_endian) & 0xffff);
+                            break;
+                        }
+                    }
+                    break;
+                }
+            }
+            rel.addend = addend + (section == ELFIO::SHN_ABS ? value : 0);
+            cand.relocs.push_back(rel);
+        }
+    }
+    return unsupported;
+}
+
+// A symbol defined in a candidate section, visible to the other files.
+struct GlobalSymbol {
+    std::string file_name;
+    uint32_t section_index;
+    uint64_t value;
+};
+
+// Sections placed by small.1.ld outside of the ordering: stage 1 (.stage1),
+// which runs from IMEM, and the uncached data of stage 2 (.uncached), which is
+// linked right after the ordered sections. Relocations refer to them with
+// indices following the candidates (see sectionAt()).
+struct StageLayout {
+    std::vector<SectionCandidate> stage1;   // In link order
+    std::vector<SectionCandidate> uncached; // In link order
+    uint32_t stage1_size = 0;               // SIZEOF(.text.stage1)
+    uint32_t stage2_base = LOAD_ADDRESS;    // Address of the first ordered section
+
+    size_t size() const { return stage1.size() + uncached.size(); }
+};
+
+// Section with the given relocation target index (see StageLayout).
+inline const SectionCandidate& sectionAt(const std::vector<SectionCandidate>& candidates, const StageLayout& layout, size_t idx) {
+    if (idx < candidates.size())
+        return candidates[idx];
+    idx -= candidates.size();
+    return idx < layout.stage1.size() ? layout.stage1[idx] : layout.uncached[idx - layout.stage1.size()];
+}
+
+inline SectionCandidate& sectionAt(std::vector<SectionCandidate>& candidates, StageLayout& layout, size_t idx) {
+    return const_cast<SectionCandidate&>(sectionAt(std::as_const(candidates), std::as_const(layout), idx));
+}
+
+// Resolve the targets of the relocations of all sections, and fill their
+// referenced_by lists. Symbols defined by the linker script are resolved to
+// their special targets. Symbols in split sections are resolved to the fragment
+// that contains them (for section symbols, the fragment containing the addressed
+// byte). Returns the number of relocations against undefined symbols, which are
+// resolved to address 0.
+int resolveRelocations(std::vector<SectionCandidate>& candidates, StageLayout& layout,
+                       const std::unordered_map<std::string, GlobalSymbol>& globals) {
+    size_t count = candidates.size() + layout.size();
+    // Fragments of each input section, by offset.
+    std::map<std::pair<std::string, uint32_t>, std::map<uint32_t, int32_t>> sections;
+    for (size_t i = 0; i < count; i++) {
+        SectionCandidate& sec = sectionAt(candidates, layout, i);
+        sections[{sec.file_name, sec.section_index}][sec.fragment_offset] = i;
+        sec.referenced_by.clear();
+    }
+    // Point rel to the fragment of a section containing the given offset.
+    auto resolveTo = [&](Relocation& rel, const std::map<uint32_t, int32_t>& fragments,
+                         int64_t symbol, int64_t offset) {
+        auto it = fragments.upper_bound(uint32_t(std::max<int64_t>(offset, 0)));
+        if (it != fragments.begin())
+            --it;
+        rel.target = it->second;
+        rel.target_offset = symbol - it->first;
+    };
+    int32_t entrypoint = TARGET_ABSOLUTE;
+    for (size_t i = 0; i < candidates.size() && entrypoint < 0; i++)
+        if (candidates[i].section_name == ".text.demo")
+            entrypoint = i;
+
+    int undefined = 0;
+    for (size_t i = 0; i < count; i++) {
+        SectionCandidate& sec = sectionAt(candidates, layout, i);
+        for (Relocation& rel : sec.relocs) {
+            rel.target = TARGET_ABSOLUTE;
+            rel.target_offset = 0;
+            if (rel.symbol_section == ELFIO::SHN_UNDEF) {
+                auto global = globals.find(rel.symbol);
+                if (rel.symbol == "_gp") {
+                    rel.target = TARGET_GP;
+                } else if (rel.symbol == "__stage2" || rel.symbol == "__stage2_start") {
+                    rel.target = TARGET_BASE;
+                } else if (rel.symbol == "__stage2_entrypoint" && entrypoint >= 0) {
+                    rel.target = entrypoint;
+                } else if (global != globals.end() &&
+                           sections.count({global->second.file_name, global->second.section_index})) {
+                    resolveTo(rel, sections[{global->second.file_name, global->second.section_index}],
+                              global->second.value, global->second.value);
+                } else {
+                    undefined++;
+                }
+            } else if (rel.symbol_section != ELFIO::SHN_ABS) {
+                auto it = sections.find({sec.file_name, rel.symbol_section});
+                if (it != sections.end())
+                    resolveTo(rel, it->second, rel.symbol_value,
+                              rel.symbol_value + (rel.section_symbol ? rel.addend : 0));
+            }
+            if (rel.target >= 0) {
+                std::vector<uint32_t>& users = sectionAt(candidates, layout, rel.target).referenced_by;
+                if (users.empty() || users.back() != i)
+                    users.push_back(i);
+            }
+        }
+    }
+    return undefined;
+}
+
+// Emulate --gc-sections: drop the candidates (and uncached sections) that are
+// not reachable through relocations (including those that are not applied)
+// from the sections kept by small.1.ld
+// (stage 1, the entrypoint, and the section defining the EXTERN symbol _start).
+// Relocations must be resolved; they are resolved again after dropping.
+// Returns the number of dropped sections.
+int collectGarbage(std::vector<SectionCandidate>& candidates, StageLayout& layout,
+                   const std::unordered_map<std::string, GlobalSymbol>& globals) {
+    size_t count = candidates.size() + layout.size();
+    std::vector<bool> reachable(count);
+    std::vector<size_t> stack;
+    auto start = globals.find("_start");
+    for (size_t i = 0; i < count; i++) {
+        const SectionCandidate& sec = sectionAt(candidates, layout, i);
+        if ((i >= candidates.size() && i < candidates.size() + layout.stage1.size()) ||
+            sec.section_name == ".text.demo" ||
+            (start != globals.end() && start->second.file_name == sec.file_name &&
+             start->second.section_index == sec.section_index))
+            stack.push_back(i);
+    }
+    // Without any root, this is not the demo link: keep everything.
+    if (stack.empty())
+        return 0;
+    while (!stack.empty()) {
+        size_t i = stack.back();
+        stack.pop_back();
+        if (reachable[i])
+            continue;
+        reachable[i] = true;
+        for (const Relocation& rel : sectionAt(candidates, layout, i).relocs)
+            if (rel.target >= 0 && !reachable[rel.target])
+                stack.push_back(rel.target);
+    }
+
+    int dropped = 0;
+    std::vector<SectionCandidate> kept;
+    for (size_t i = 0; i < candidates.size(); i++) {
+        if (reachable[i])
+            kept.push_back(std::move(candidates[i]));
+        else
+            dropped++;
+    }
+    candidates = std::move(kept);
+    kept.clear();
+    size_t uncachedStart = count - layout.uncached.size();
+    for (size_t i = 0; i < layout.uncached.size(); i++) {
+        if (reachable[uncachedStart + i])
+            kept.push_back(std::move(layout.uncached[i]));
+        else
+            dropped++;
+    }
+    layout.uncached = std::move(kept);
+    resolveRelocations(candidates, layout, globals);
+    return dropped;
+}
+
+// Split the largest splittable sections into fragments at the symbols defined
+// in them, so that the objects they hold can be ordered independently.
+// Every fragment keeps the alignment of its offset in the section, and the
+// relocations that fall into it; fragments smaller than FRAGMENT_MIN_SIZE are
+// merged with the previous one. The number of fragments added is capped at
+// maxFragments, as each one slows down the search: sections are split by
+// decreasing size, and the fragments of the last one are merged to fit.
+// Fragments replace their section in place, so the order is unchanged.
+// Relocations must be resolved again afterwards. Returns the number of
+// fragments added.
+int splitSections(std::vector<SectionCandidate>& candidates, int maxFragments) {
+    // Fragment boundaries of each splittable section.
+    std::vector<std::vector<uint32_t>> splits(candidates.size());
+    std::vector<size_t> order;
+    for (size_t i = 0; i < candidates.size(); i++) {
+        const SectionCandidate& cand = candidates[i];
+        if (!cand.splittable || cand.fragment_offset != 0)
+            continue;
+        uint32_t last = 0;
+        for (uint32_t offset : cand.symbol_offsets) {
+            if (offset - last >= FRAGMENT_MIN_SIZE && cand.size - offset >= FRAGMENT_MIN_SIZE) {
+                splits[i].push_back(offset);
+                last = offset;
+            }
+        }
+        if (!splits[i].empty())
+            order.push_back(i);
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return candidates[a].size > candidates[b].size;
+    });
+    int added = 0;
+    for (size_t i : order) {
+        std::vector<uint32_t>& points = splits[i];
+        if (added >= maxFragments) {
+            points.clear();
+            continue;
+        }
+        // Merge the smallest fragments until the section fits the budget.
+        while (points.size() > size_t(maxFragments - added)) {
+            size_t smallest = 0, smallestSize = UINT32_MAX;
+            for (size_t k = 0; k < points.size(); k++) {
+                uint32_t end = k + 1 < points.size() ? points[k + 1] : candidates[i].size;
+                if (end - points[k] < smallestSize) {
+                    smallest = k;
+                    smallestSize = end - points[k];
+                }
+            }
+            points.erase(points.begin() + smallest);
+        }
+        added += points.size();
+    }
+
+    std::vector<SectionCandidate> result;
+    for (size_t i = 0; i < candidates.size(); i++) {
+        SectionCandidate& cand = candidates[i];
+        if (splits[i].empty()) {
+            result.push_back(std::move(cand));
+            continue;
+        }
+        std::vector<uint32_t> bounds = splits[i];
+        bounds.insert(bounds.begin(), 0);
+        bounds.push_back(cand.size);
+        for (size_t k = 0; k + 1 < bounds.size(); k++) {
+            uint32_t start = bounds[k], end = bounds[k + 1];
+            SectionCandidate frag = cand;
+            frag.fragment_offset = start;
+            frag.size = end - start;
+            // Alignment: the largest power of two dividing the offset, up to
+            // the alignment of the section.
+            if (start != 0)
+                frag.alignment = std::min(cand.alignment, start & -start);
+            if (!cand.nobits)
+                frag.data.assign(cand.data.begin() + start, cand.data.begin() + end);
+            frag.relocs.clear();
+            for (const Relocation& rel : cand.relocs) {
+                if (rel.offset >= start && rel.offset < end) {
+                    frag.relocs.push_back(rel);
+                    frag.relocs.back().offset -= start;
+                }
+            }
+            frag.symbol_offsets.clear();
+            foldZeroRuns(frag);
+            result.push_back(std::move(frag));
+        }
+    }
+    candidates = std::move(result);
+    return added;
+}
+
+// Apply the relocations of a candidate to its contents in dest: the folded image
+// if 'image' is true, else the section data. 'addresses' holds the address of
+// every candidate, base the start of the sections.
+void relocateSection(const SectionCandidate& cand,
+                     const std::vector<uint32_t>& addresses, uint32_t base,
+                     uint8_t* dest, bool image) {
+    for (const Relocation& rel : cand.relocs) {
+        if (!rel.apply)
+            continue;
+        uint32_t S;
+        switch (rel.target) {
+        case TARGET_ABSOLUTE: S = 0; break;
+        case TARGET_BASE:     S = base; break;
+        case TARGET_GP:       S = base + GP_OFFSET; break;
+        default:              S = addresses[rel.target] + rel.target_offset; break;
+        }
+        S += uint32_t(rel.addend);
+        uint8_t* p = dest + (image ? rel.image_offset : rel.offset);
+        uint32_t insn = readWord(p, cand.big_endian);
+        switch (rel.type) {
+        case R_MIPS_32:      insn = S; break;
+        case R_MIPS_26:      insn = (insn & 0xfc000000) | ((S >> 2) & 0x3ffffff); break;
+        case R_MIPS_HI16:    insn = (insn & 0xffff0000) | ((S + 0x8000) >> 16); break;
+        case R_MIPS_LO16:    insn = (insn & 0xffff0000) | (S & 0xffff); break;
+        case R_MIPS_GPREL16: insn = (insn & 0xffff0000) | ((S - base - GP_OFFSET) & 0xffff); break;
+        }
+        writeWord(p, insn, cand.big_endian);
+    }
+}
+
+// Compute the address of every section (see StageLayout for the indices) for
+// an ordering, as small.1.ld lays them out; input sections are aligned on their
+// absolute address. addresses must already have the right size. Returns the
+// end address of .text.stage2 (after its final ALIGN(8)).
+uint32_t layoutSections(const std::vector<SectionCandidate>& candidates,
+                        const StageLayout& layout,
+                        const std::vector<size_t>& permutation,
+                        std::vector<uint32_t>& addresses) {
+    uint32_t address = IMEM_ADDRESS;
+    for (size_t i = 0; i < layout.stage1.size(); i++) {
+        address = align_up(address, layout.stage1[i].alignment);
+        addresses[candidates.size() + i] = address;
+        address += layout.stage1[i].size;
+    }
+    address = layout.stage2_base;
+    for (size_t idx : permutation) {
+        address = align_up(address, candidates[idx].alignment);
+        addresses[idx] = address;
+        address += candidates[idx].size;
+    }
+    uint32_t stage2_end = align_up(address, STAGE_ALIGNMENT);
+    address = UNCACHED_ADDRESS + layout.stage1_size + (stage2_end - layout.stage2_base);
+    for (size_t i = 0; i < layout.uncached.size(); i++) {
+        address = align_up(address, layout.uncached[i].alignment);
+        addresses[candidates.size() + layout.stage1.size() + i] = address;
+        address += layout.uncached[i].size;
+    }
+    return stage2_end;
+}
+
+// Link an ordering: return the contents of .text.stage2 followed by those of
+// .text.stage2u, as extracted from the ELF by the Makefile.
+std::vector<uint8_t> linkStage2(const std::vector<SectionCandidate>& candidates,
+                                const StageLayout& layout,
+                                const std::vector<size_t>& permutation) {
+    std::vector<uint32_t> addresses(candidates.size() + layout.size());
+    uint32_t stage2_end = layoutSections(candidates, layout, permutation, addresses);
+    uint32_t stage2u_start = UNCACHED_ADDRESS + layout.stage1_size + (stage2_end - layout.stage2_base);
+    std::vector<uint8_t> out;
+    // Pad up to the section offset in the output, then append its contents.
+    auto place = [&](const SectionCandidate& sec, size_t offset) {
+        out.resize(offset, 0);
+        if (sec.nobits)
+            out.resize(offset + sec.size, 0);
+        else
+            out.insert(out.end(), sec.data.begin(), sec.data.end());
+        relocateSection(sec, addresses, layout.stage2_base, out.data() + offset, false);
+    };
+    for (size_t idx : permutation)
+        place(candidates[idx], addresses[idx] - layout.stage2_base);
+    out.resize(stage2_end - layout.stage2_base, 0);
+    size_t stage2_size = out.size();
+    for (size_t i = 0; i < layout.uncached.size(); i++)
+        place(layout.uncached[i], stage2_size + addresses[candidates.size() + layout.stage1.size() + i] - stage2u_start);
+    return out;
+}
+
+// -----------------------------------------------------------------------------
+// CONSTRAINTS
+// -----------------------------------------------------------------------------
+
+// Check all the placement rules of the candidates against a permutation.
+// This only looks at sizes and alignments, so it runs in O(n) and is done
+// before building the flat binary, to avoid paying for orderings that can
+// never be linked. Offsets are relative to the address of the first section,
+// base, on which the alignment depends.
+bool checkConstraints(const std::vector<SectionCandidate>& candidates,
+                      const std::vector<size_t>& permutation,
+                      uint32_t base) {
+    uint32_t offset = 0;
+    for (size_t k = 0; k < permutation.size(); k++) {
+        const SectionCandidate& cand = candidates[permutation[k]];
+        offset = align_up(base + offset, cand.alignment) - base;
+        if (offset < cand.region_start || uint64_t(offset) + cand.size > cand.region_end)
+            return false;
+        if (cand.pin >= 0 && size_t(cand.pin) != k)
+            return false;
+        if (cand.follows >= 0 && (k == 0 || permutation[k - 1] != size_t(cand.follows)))
+            return false;
+        offset += cand.size;
+    }
+    return true;
+}
+
+// Name of a candidate in the section orders: "file(section)", followed by
+// "+0xOFFSET" for the fragments of a split section after the first one.
+std::string sectionKey(const SectionCandidate& cand) {
+    std::string key = cand.file_name + "(" + cand.section_name + ")";
+    if (cand.fragment_offset != 0) {
+        std::ostringstream offset;
+        offset << "+0x" << std::hex << cand.fragment_offset;
+        key += offset.str();
+    }
+    return key;
+}
+
+// Return the indices of the candidates matching a section specification, which
+// is either "file(section)" or just a section name (matching it in all files,
+// and all its fragments), or the key of a fragment.
+std::vector<size_t> matchSections(const std::vector<SectionCandidate>& candidates,
+                                  const std::string& spec) {
+    std::vector<size_t> matches;
+    for (size_t i = 0; i < candidates.size(); i++) {
+        const SectionCandidate& cand = candidates[i];
+        if (spec == cand.section_name || spec == cand.file_name + "(" + cand.section_name + ")" ||
+            spec == sectionKey(cand))
+            matches.push_back(i);
+    }
+    return matches;
+}
+
+// Description of the first placement rule that a permutation breaks, for error
+// messages, or an empty string if it follows them all (see checkConstraints()).
+std::string describeViolation(const std::vector<SectionCandidate>& candidates,
+                              const std::vector<size_t>& permutation,
+                              uint32_t base) {
+    std::ostringstream ss;
+    ss << std::hex << std::showbase;
+    uint32_t offset = 0;
+    for (size_t k = 0; k < permutation.size(); k++) {
+        const SectionCandidate& cand = candidates[permutation[k]];
+        std::string name = cand.file_name + "(" + cand.section_name + ")";
+        offset = align_up(base + offset, cand.alignment) - base;
+        if (offset < cand.region_start || uint64_t(offset) + cand.size > cand.region_end) {
+            ss << name << " at offset " << offset << " with size " << cand.size
+               << " is not within its region [" << cand.region_start << ", " << cand.region_end << ")";
+            return ss.str();
+        }
+        if (cand.pin >= 0 && size_t(cand.pin) != k) {
+            ss << std::dec << name << " is at position " << k << " instead of " << cand.pin;
+            return ss.str();
+        }
+        if (cand.follows >= 0 && (k == 0 || permutation[k - 1] != size_t(cand.follows))) {
+            const SectionCandidate& prev = candidates[cand.follows];
+            ss << name << " does not follow " << prev.file_name << "(" << prev.section_name << ")";
+            return ss.str();
+        }
+        offset += cand.size;
+    }
+    return "";
+}
+
+// Rearrange a permutation so that the placement rules hold: every section that
+// must follow another is moved right after it, then pinned sections are moved
+// to their positions. If a region rule is still broken, the sections that must
+// end before some offset are moved first, keeping their order, and the other
+// rules applied again. Returns whether the result follows all the rules; it
+// may not, as the rules can contradict each other.
+bool applyConstraints(const std::vector<SectionCandidate>& candidates,
+                      std::vector<size_t>& permutation,
+                      uint32_t base) {
+    auto moveTo = [&](size_t idx, size_t pos) {
+        permutation.erase(std::find(permutation.begin(), permutation.end(), idx));
+        permutation.insert(permutation.begin() + std::min(pos, permutation.size()), idx);
+    };
+    auto applyOrderRules = [&]() {
+        // Repeat until stable, to handle chains of adjacent sections.
+        for (size_t pass = 0; pass < candidates.size(); pass++) {
+            bool changed = false;
+            for (size_t idx = 0; idx < candidates.size(); idx++) {
+                int follows = candidates[idx].follows;
+                if (follows < 0)
+                    continue;
+                size_t pos = std::find(permutation.begin(), permutation.end(), idx) - permutation.begin();
+                if (pos > 0 && permutation[pos - 1] == size_t(follows))
+                    continue;
+                permutation.erase(permutation.begin() + pos);
+                pos = std::find(permutation.begin(), permutation.end(), size_t(follows)) - permutation.begin();
+                permutation.insert(permutation.begin() + pos + 1, idx);
+                changed = true;
+            }
+            if (!changed)
+                break;
+        }
+        std::vector<size_t> pinned;
+        for (size_t idx = 0; idx < candidates.size(); idx++)
+            if (candidates[idx].pin >= 0)
+                pinned.push_back(idx);
+        std::sort(pinned.begin(), pinned.end(), [&](size_t a, size_t b) {
+            return candidates[a].pin < candidates[b].pin;
+        });
+        for (size_t idx : pinned)
+            moveTo(idx, candidates[idx].pin);
+    };
+    applyOrderRules();
+    if (checkConstraints(candidates, permutation, base))
+        return true;
+    std::stable_partition(permutation.begin(), permutation.end(), [&](size_t idx) {
+        return candidates[idx].region_end != UINT32_MAX;
+    });
+    applyOrderRules();
+    return checkConstraints(candidates, permutation, base);
+}
+
+// -----------------------------------------------------------------------------
+// TRANSPOSITION CACHE
+// -----------------------------------------------------------------------------
+
+// Key of a section at a given position of the ordering (splitmix64 finalizer).
+// The hash of a permutation is the XOR of the keys of all its positions
+// (Zobrist hashing), so a move can update it by only visiting the positions
+// it changes.
+inline uint64_t zobristKey(size_t pos, size_t idx) {
+    uint64_t x = (uint64_t(pos) << 32 | idx) + 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+uint64_t permutationHash(const std::vector<size_t>& permutation) {
+    uint64_t hash = 0;
+    for (size_t k = 0; k < permutation.size(); k++)
+        hash ^= zobristKey(k, permutation[k]);
+    return hash;
+}
+
+// Lock-free cache of the costs of the evaluated permutations, shared by all
+// threads. An entry is made of two words: the cost, and the hash XORed with
+// the cost. Readers validate an entry by XORing them back, so an entry torn by
+// a concurrent write is simply a miss.
+// The table has a fixed size and is organized in buckets of 4 entries. When a
+// bucket is full, a new entry replaces one of them chosen by its hash, so that
+// memory stays bounded on long runs.
+class TranspositionCache {
+public:
+    explicit TranspositionCache(size_t bytes) {
+        size_t buckets = 1;
+        while (buckets * 2 * sizeof(Bucket) <= bytes)
+            buckets *= 2;
+        table.reset(new Bucket[buckets]);
+        mask = buckets - 1;
+    }
+
+    bool lookup(uint64_t hash, double& cost) const {
+        const Bucket& bucket = table[hash & mask];
+        for (const Entry& e : bucket.entries) {
+            uint64_t bits = e.cost.load(std::memory_order_relaxed);
+            if (bits != 0 && (e.check.load(std::memory_order_relaxed) ^ bits) == hash) {
+                cost = std::bit_cast<double>(bits);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void store(uint64_t hash, double cost) {
+        uint64_t bits = std::bit_cast<uint64_t>(cost);
+        Bucket& bucket = table[hash & mask];
+        Entry* slot = &bucket.entries[hash >> 62];
+        for (Entry& e : bucket.entries) {
+            uint64_t old = e.cost.load(std::memory_order_relaxed);
+            // An empty entry is claimed by setting its cost, so that concurrent
+            // stores never count the same entry twice.
+            if (old == 0 && e.cost.compare_exchange_strong(old, bits, std::memory_order_relaxed)) {
+                used.fetch_add(1, std::memory_order_relaxed);
+                e.check.store(hash ^ bits, std::memory_order_relaxed);
+                return;
+            }
+            if ((e.check.load(std::memory_order_relaxed) ^ old) == hash) {
+                slot = &e;
+                break;
+            }
+        }
+        slot->cost.store(bits, std::memory_order_relaxed);
+        slot->check.store(hash ^ bits, std::memory_order_relaxed);
+    }
+
+    size_t bytes() const { return (mask + 1) * sizeof(Bucket); }
+    size_t capacity() const { return (mask + 1) * 4; }
+    size_t size() const { return used.load(std::memory_order_relaxed); }
+
+private:
+    struct Entry {
+        std::atomic<uint64_t> check{0};
+        std::atomic<uint64_t> cost{0};  // 0 (a 0.0 cost) means empty
+    };
+    struct alignas(64) Bucket {
+        Entry entries[4];
+    };
+
+    std::unique_ptr<Bucket[]> table;
+    size_t mask;
+    std::atomic<size_t> used{0};
+};
+
+// -----------------------------------------------------------------------------
+// AFFINITY
+// -----------------------------------------------------------------------------
+
+// Number of partners kept for each section by the affinity move.
+const size_t AFFINITY_PARTNERS = 8;
+// Maximum number of local search passes of affinitySeed().
+const int SEED_MAX_PASSES = 100;
+
+// Pairwise affinity of the candidates: saved(a, b) is the number of bits saved
+// by compressing section b right after section a, instead of on its own.
+// Most of the compression gain of an ordering comes from the sections that end
+// up next to each other, so this is a cheap model of the cost of an ordering.
+struct AffinityMatrix {
+    size_t n = 0;
+    std::vector<float> bits;                        // saved(a, b) at a * n + b
+    std::vector<std::vector<uint32_t>> partners;    // Best partners of each section, either way
+
+    float saved(size_t a, size_t b) const { return bits[a * n + b]; }
+};
+
+// Compute the affinity matrix of the candidates, in parallel. The images are
+// compressed as they are in the arena (folded, unrelocated), with the
+// incremental compressor: each row commits section a once, then every pair
+// a+b only re-encodes b from the checkpoint at the end of a.
+AffinityMatrix computeAffinity(const std::vector<SectionCandidate>& candidates) {
+    AffinityMatrix m;
+    m.n = candidates.size();
+    m.bits.assign(m.n * m.n, 0);
+    m.partners.resize(m.n);
+
+    // Cost of each section alone, split in one chunk per worker so that each
+    // compressor context is allocated once.
+    std::vector<double> alone(m.n, 0);
+    int chunks = std::min<int>(ThreadPool::global().size(), m.n);
+    ThreadPool::global().parallelFor(chunks, [&](int chunk) {
+        upkr_incremental* ctx = upkr_incremental_new();
+        for (size_t b = chunk; b < m.n; b += chunks) {
+            const std::vector<uint8_t>& image = candidates[b].image;
+            size_t end = image.size();
+            if (end)
+                alone[b] = upkr_incremental_eval(ctx, image.data(), end, &end, 1);
+        }
+        upkr_incremental_free(ctx);
+    });
+
+    ThreadPool::global().parallelFor(m.n, [&](int a) {
+        const std::vector<uint8_t>& first = candidates[a].image;
+        if (first.empty())
+            return;
+        upkr_incremental* ctx = upkr_incremental_new();
+        std::vector<uint8_t> data(first);
+        size_t ends[2] = { first.size(), first.size() };
+        double base = upkr_incremental_eval(ctx, data.data(), data.size(), ends, 1);
+        upkr_incremental_commit(ctx);
+        for (size_t b = 0; b < m.n; b++) {
+            const std::vector<uint8_t>& second = candidates[b].image;
+            if (size_t(a) == b || second.empty())
+                continue;
+            data.resize(first.size());
+            data.insert(data.end(), second.begin(), second.end());
+            ends[1] = data.size();
+            double pair = upkr_incremental_eval(ctx, data.data(), data.size(), ends, 2);
+            m.bits[a * m.n + b] = float(alone[b] - (pair - base));
+        }
+        upkr_incremental_free(ctx);
+    });
+
+    for (size_t a = 0; a < m.n; a++) {
+        std::vector<uint32_t>& partners = m.partners[a];
+        for (size_t b = 0; b < m.n; b++)
+            if (b != a && std::max(m.saved(a, b), m.saved(b, a)) > 0)
+                partners.push_back(b);
+        auto affinity = [&](uint32_t b) { return std::max(m.saved(a, b), m.saved(b, a)); };
+        std::stable_sort(partners.begin(), partners.end(), [&](uint32_t x, uint32_t y) {
+            return affinity(x) > affinity(y);
+        });
+        if (partners.size() > AFFINITY_PARTNERS)
+            partners.resize(AFFINITY_PARTNERS);
+    }
+    return m;
+}
+
+// Build an ordering that maximizes the affinity between consecutive sections,
+// that is an open path through the asymmetric TSP of the affinity matrix.
+// The path is built by nearest neighbour from every starting section, keeping
+// the best, then improved by local search: 2-opt (reversing a run of sections)
+// and Or-opt (moving a run of up to 3 sections elsewhere), until no move
+// improves it. Placement rules are not taken into account.
+std::vector<size_t> affinitySeed(const AffinityMatrix& m) {
+    size_t n = m.n;
+    std::vector<size_t> path;
+    if (n < 2) {
+        for (size_t i = 0; i < n; i++)
+            path.push_back(i);
+        return path;
+    }
+    auto pathAffinity = [&](const std::vector<size_t>& p) {
+        double total = 0;
+        for (size_t k = 0; k + 1 < p.size(); k++)
+            total += m.saved(p[k], p[k + 1]);
+        return total;
+    };
+
+    double best = -1;
+    std::vector<size_t> candidate;
+    std::vector<uint8_t> visited;
+    for (size_t start = 0; start < n; start++) {
+        candidate.assign(1, start);
+        visited.assign(n, 0);
+        visited[start] = 1;
+        for (size_t k = 1; k < n; k++) {
+            size_t last = candidate.back(), next = n;
+            for (size_t b = 0; b < n; b++)
+                if (!visited[b] && (next == n || m.saved(last, b) > m.saved(last, next)))
+                    next = b;
+            candidate.push_back(next);
+            visited[next] = 1;
+        }
+        double total = pathAffinity(candidate);
+        if (total > best) {
+            best = total;
+            path = candidate;
+        }
+    }
+
+    // Affinity of the edge between positions k and k+1 of the path, where the
+    // ends of the path have no neighbour.
+    const double EPSILON = 1e-3;
+    auto edge = [&](size_t a, size_t b) { return a < n && b < n ? double(m.saved(a, b)) : 0.0; };
+    auto at = [&](size_t k) { return k < path.size() ? path[k] : n; };
+    for (int pass = 0; pass < SEED_MAX_PASSES; pass++) {
+        bool improved = false;
+
+        // 2-opt: reverse path[i..j]. In the asymmetric case the edges inside
+        // the run change direction, so their sums are tracked both ways.
+        for (size_t i = 0; i < n; i++) {
+            double forward = 0, backward = 0;
+            size_t before = i ? path[i - 1] : n;
+            for (size_t j = i + 1; j < n; j++) {
+                forward += edge(path[j - 1], path[j]);
+                backward += edge(path[j], path[j - 1]);
+                double gain = edge(before, path[j]) + edge(path[i], at(j + 1)) + backward
+                            - edge(before, path[i]) - edge(path[j], at(j + 1)) - forward;
+                if (gain > EPSILON) {
+                    std::reverse(path.begin() + i, path.begin() + j + 1);
+                    improved = true;
+                    break;
+                }
+            }
+        }
+
+        // Or-opt: move path[i..i+len) between path[j-1] and path[j], for j
+        // outside of the run.
+        for (size_t len = 1; len <= 3; len++) {
+            for (size_t i = 0; i + len <= n; i++) {
+                size_t first = path[i], last = path[i + len - 1];
+                size_t before = i ? path[i - 1] : n, after = at(i + len);
+                double removed = edge(before, first) + edge(last, after) - edge(before, after);
+                for (size_t j = 0; j <= n; j++) {
+                    if (j >= i && j <= i + len)
+                        continue;
+                    size_t prev = j ? path[j - 1] : n, next = at(j);
+                    double gain = edge(prev, first) + edge(last, next) - edge(prev, next) - removed;
+                    if (gain > EPSILON) {
+                        if (j < i)
+                            std::rotate(path.begin() + j, path.begin() + i, path.begin() + i + len);
+                        else
+                            std::rotate(path.begin() + i, path.begin() + i + len, path.begin() + j);
+                        improved = true;
+                        break;
+                    }
+                }
+            }
+        }
+        if (!improved)
+            break;
+    }
+    return path;
+}
+
+// -----------------------------------------------------------------------------
+// MOVE OPERATORS
+// -----------------------------------------------------------------------------
+
+enum MoveOp { MOVE_SWAP, MOVE_ADJACENT, MOVE_INSERT, MOVE_BLOCK, MOVE_REVERSE, MOVE_AFFINITY, MOVE_COUNT };
+const char* const MOVE_NAMES[MOVE_COUNT] = { "swap", "adjacent", "insert", "block", "reverse", "affinity" };
+
+// A move on a permutation, that can be applied and reverted in place.
+// Insert and block moves are both rotations of the range [a, c) around b, that is
+// they exchange the adjacent blocks [a, b) and [b, c); an insert is the case
+// where one of the two blocks is a single section. Reverse reverses [a, b).
+// Affinity moves are inserts (see affinityMove()).
+struct Move {
+    MoveOp op;
+    size_t a, b, c;
+
+    void apply(std::vector<size_t>& perm) const {
+        switch (op) {
+        case MOVE_SWAP:     std::swap(perm[a], perm[b]); break;
+        case MOVE_ADJACENT: std::swap(perm[a], perm[a + 1]); break;
+        case MOVE_INSERT:
+        case MOVE_AFFINITY:
+        case MOVE_BLOCK:    std::rotate(perm.begin() + a, perm.begin() + b, perm.begin() + c); break;
+        case MOVE_REVERSE:  std::reverse(perm.begin() + a, perm.begin() + b); break;
+        default:            assert(0);
+        }
+    }
+
+    // XOR into hash the Zobrist keys of the positions changed by the move. Called
+    // before and after apply(), this updates the hash of the permutation.
+    void toggleHash(const std::vector<size_t>& perm, uint64_t& hash) const {
+        auto toggle = [&](size_t first, size_t last) {
+            for (size_t k = first; k < last; k++)
+                hash ^= zobristKey(k, perm[k]);
+        };
+        switch (op) {
+        case MOVE_SWAP:     toggle(a, a + 1); toggle(b, b + 1); break;
+        case MOVE_ADJACENT: toggle(a, a + 2); break;
+        case MOVE_INSERT:
+        case MOVE_AFFINITY:
+        case MOVE_BLOCK:    toggle(a, c); break;
+        case MOVE_REVERSE:  toggle(a, b); break;
+        default:            assert(0);
+        }
+    }
+
+    void revert(std::vector<size_t>& perm) const {
+        if (op == MOVE_INSERT || op == MOVE_AFFINITY || op == MOVE_BLOCK)
+            std::rotate(perm.begin() + a, perm.begin() + a + (c - b), perm.begin() + c);
+        else
+            apply(perm);
+    }
+};
+
+// Draw a random move of the given kind over a permutation of n >= 2 elements.
+// Moves that would leave the permutation unchanged are never generated.
+Move randomMove(MoveOp op, size_t n, std::mt19937& rng) {
+    std::uniform_int_distribution<size_t> index_dist(0, n - 1);
+    Move m{op, 0, 0, 0};
+    switch (op) {
+    case MOVE_SWAP:
+    case MOVE_REVERSE: {
+        size_t i = index_dist(rng), j;
+        do j = index_dist(rng); while (j == i);
+        m.a = std::min(i, j);
+        m.b = std::max(i, j) + (op == MOVE_REVERSE);
+        break;
+    }
+    case MOVE_ADJACENT:
+        m.a = std::uniform_int_distribution<size_t>(0, n - 2)(rng);
+        break;
+    case MOVE_INSERT: {
+        // Move the element at 'from' to position 'to'.
+        size_t from = index_dist(rng), to;
+        do to = index_dist(rng); while (to == from);
+        if (from < to) { m.a = from; m.b = from + 1; m.c = to + 1; }
+        else           { m.a = to;   m.b = from;     m.c = from + 1; }
+        break;
+    }
+    case MOVE_BLOCK: {
+        // Three distinct cut points in [0, n] delimit the two blocks to exchange.
+        std::uniform_int_distribution<size_t> cut_dist(0, n);
+        size_t cuts[3];
+        cuts[0] = cut_dist(rng);
+        do cuts[1] = cut_dist(rng); while (cuts[1] == cuts[0]);
+        do cuts[2] = cut_dist(rng); while (cuts[2] == cuts[0] || cuts[2] == cuts[1]);
+        std::sort(cuts, cuts + 3);
+        m.a = cuts[0]; m.b = cuts[1]; m.c = cuts[2];
+        break;
+    }
+    default:
+        assert(0);
+    }
+    return m;
+}
+
+// Draw a move that brings a random section next to one of its best partners
+// in the affinity matrix: the partner is moved right after the section, or
+// right before it, whichever saves more. If the section has no partners, or is
+// already next to the partner on that side, this is a random insert instead.
+Move affinityMove(const std::vector<size_t>& perm, const AffinityMatrix& affinity, std::mt19937& rng) {
+    size_t n = perm.size();
+    size_t i = std::uniform_int_distribution<size_t>(0, n - 1)(rng);
+    const std::vector<uint32_t>& partners = affinity.partners[perm[i]];
+    Move m{MOVE_AFFINITY, 0, 0, 0};
+    if (!partners.empty()) {
+        size_t partner = partners[std::uniform_int_distribution<size_t>(0, partners.size() - 1)(rng)];
+        size_t j = std::find(perm.begin(), perm.end(), partner) - perm.begin();
+        if (affinity.saved(perm[i], partner) >= affinity.saved(partner, perm[i])) {
+            // Move the partner from j to i + 1.
+            if (j > i + 1)  { m.a = i + 1; m.b = j; m.c = j + 1; return m; }
+            if (j < i)      { m.a = j; m.b = j + 1; m.c = i + 1; return m; }
+        } else {
+            // Move the partner from j to i - 1.
+            if (j > i)      { m.a = i; m.b = j; m.c = j + 1; return m; }
+            if (j + 1 < i)  { m.a = j; m.b = j + 1; m.c = i; return m; }
+        }
+    }
+    m = randomMove(MOVE_INSERT, n, rng);
+    m.op = MOVE_AFFINITY;
+    return m;
+}
+
+// Adaptive operator selection (probability matching). Each operator keeps an
+// exponential moving average of the reward of its recent moves, and is picked
+// with a probability proportional to it, plus a floor so that no operator is
+// ever starved (its usefulness changes as the temperature goes down).
+struct MoveSelector {
+    static constexpr double DECAY = 0.02;
+    static constexpr double MIN_PROBABILITY = 0.05;
+    // Rewards: a move that lowers the cost is worth much more than a move that
+    // is just accepted. Invalid and rejected moves get nothing.
+    static constexpr double REWARD_IMPROVED = 1.0;
+    static constexpr double REWARD_ACCEPTED = 0.25;
+
+    double quality[MOVE_COUNT];
+
+    MoveSelector() { std::fill(quality, quality + MOVE_COUNT, REWARD_IMPROVED); }
+
+    MoveOp pick(std::mt19937& rng) const {
+        double total = 0;
+        for (double q : quality) total += q;
+        double x = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+        for (int op = 0; op < MOVE_COUNT - 1; op++) {
+            double share = total > 0 ? quality[op] / total : 1.0 / int(MOVE_COUNT);
+            x -= MIN_PROBABILITY + (1.0 - int(MOVE_COUNT) * MIN_PROBABILITY) * share;
+            if (x < 0)
+                return MoveOp(op);
+        }
+        return MoveOp(MOVE_COUNT - 1);
+    }
+
+    void reward(MoveOp op, double r) {
+        quality[op] += DECAY * (r - quality[op]);
+    }
+};
+
+// Counter updated by a single thread, that other threads can read at any time
+// (see Telemetry). Updates are plain loads and stores, without locking.
+struct Counter {
+    std::atomic<uint64_t> value{0};
+
+    void operator+=(uint64_t n) {
+        value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+    void operator++(int) { *this += 1; }
+    operator uint64_t() const { return value.load(std::memory_order_relaxed); }
+};
+
+// Current time in nanoseconds, for the time accounting of the engines.
+inline uint64_t nanoTime() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Per-operator statistics, reported at the end of the run.
+struct MoveStats {
+    Counter tried;          // Moves generated
+    Counter invalid;        // Moves discarded because the ordering broke a constraint
+    Counter accepted;       // Moves accepted by the Metropolis criterion
+    Counter improved;       // Accepted moves that lowered the cost
+};
+
+// -----------------------------------------------------------------------------
+// HEAP ALLOCATION ACCOUNTING
+// -----------------------------------------------------------------------------
+
+// Number of heap allocations done by the current thread. The global operator new
+// is replaced so that the evaluation loop can prove that it doesn't allocate
+// once its arenas reached their steady-state size.
+thread_local uint64_t t_heap_allocations = 0;
+
+void* operator new(size_t size) {
+    t_heap_allocations++;
+    if (void* ptr = std::malloc(size ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+// Not inlined, or GCC warns about free() being called on memory from new.
+__attribute__((noinline)) void operator delete(void* ptr) noexcept { std::free(ptr); }
+__attribute__((noinline)) void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+
+// Heap allocations done by the current thread, both here and in the upkr library.
+inline uint64_t heapAllocations() {
+    return t_heap_allocations + upkr_allocation_count();
+}
+
+// -----------------------------------------------------------------------------
+// EVALUATION ENGINE
+// -----------------------------------------------------------------------------
+
+// Per-thread evaluation state. It owns the arenas used to build the flat binary
+// and the permutation being annealed, plus the incremental compressor context
+// and a full compressor context for the exact costs.
+// Buffers are only ever grown, so after the first evaluation no further heap
+// allocation is needed.
+struct EvalEngine {
+    upkr_incremental* ctx;
+    upkr_context* packer;               // Compressor buffers reused by exactCost()
+    std::vector<uint8_t> flat;          // Flat binary arena (compressor view, see foldZeroRuns)
+    std::vector<size_t> segmentEnds;    // End offset of each segment in flat
+    std::vector<size_t> builtPerm;      // Permutation flat was built from (empty if none)
+    size_t unchanged = 0;               // Bytes of flat that are the same as in the previous build
+    std::vector<size_t> perm;           // Permutation arena (moves are applied in place)
+    uint32_t foldedBits = 0;            // Estimated cost of the zeros folded out of flat
+    const StageLayout* layout = nullptr; // Placement of the stages (must be set)
+    const AffinityMatrix* affinity = nullptr; // Section affinities, for the affinity moves (must be set to anneal)
+    std::vector<std::vector<uint8_t>> images;   // Relocated image of each candidate (empty if none)
+    std::vector<uint32_t> addresses;    // Address of each section in the layout of the images
+    std::vector<uint32_t> nextAddresses; // Addresses of the binary being built
+    std::vector<uint8_t> dirty;         // Sections whose relocated image must be patched
+    uint64_t relocationKey = 0;         // Identifies the layout of the images, in cache keys
+
+    uint64_t hash = 0;                  // Zobrist hash of perm
+    TranspositionCache* cache = nullptr; // Shared cache of evaluated costs (optional)
+    bool stale = false;                 // Last evaluation was served by the cache
+    Counter evaluations;                // Number of evaluations performed
+    Counter cache_hits;                 // Number of evaluations served by the cache
+    Counter buildNanos;                 // Time spent building the flat binaries
+    Counter compressNanos;              // Time spent in the compressor
+    Counter constraintNanos;            // Time spent checking the placement rules
+    Counter evaluatedBytes;             // Size of the evaluated binaries
+    Counter reencodedBytes;             // Part of it that the compressor re-encoded
+    std::atomic<double> temperature{0}; // Temperature of the last annealing step
+    std::atomic<double> chainBest{MAX_COST}; // Best cost found by the current chain
+    uint64_t steady_allocations = 0;    // Heap allocations made in the annealing loops
+    MoveSelector selector;              // Adaptive move operator selection
+    MoveStats moveStats[MOVE_COUNT];    // Statistics of each move operator
+
+    EvalEngine() : ctx(upkr_incremental_new()), packer(upkr_context_new()) {}
+    ~EvalEngine() {
+        upkr_incremental_free(ctx);
+        upkr_context_free(packer);
+    }
+    EvalEngine(const EvalEngine&) = delete;
+    EvalEngine& operator=(const EvalEngine&) = delete;
+
+    // Apply the relocations of the section images as the linker would for the
+    // layout of a permutation, so that the compressor sees the real call targets
+    // and addresses. Only the images of the sections that reference a section
+    // moved since the previous call are patched again.
+    // The following evaluations keep these images, even for permutations that
+    // move sections: otherwise, the sections that reference a moved one would
+    // change too, and as some of them are usually near the start of the binary,
+    // nearly all of it would be re-encoded for every move. The annealing chains
+    // and tempering epochs call this when they start, so their screening costs
+    // use relocations batched at that point, and the confirmation at the final
+    // level uses the real ones.
+    void relocate(const std::vector<SectionCandidate>& candidates,
+                  const std::vector<size_t>& permutation) {
+        size_t count = candidates.size() + layout->size();
+        if (images.size() != candidates.size()) {
+            images.assign(candidates.size(), {});
+            addresses.assign(count, UINT32_MAX);
+            nextAddresses.assign(count, 0);
+            dirty.assign(count, 0);
+            for (size_t i = 0; i < candidates.size(); i++)
+                if (!candidates[i].relocs.empty())
+                    images[i] = candidates[i].image;
+        }
+        layoutSections(candidates, *layout, permutation, nextAddresses);
+        for (size_t i = 0; i < count; i++) {
+            if (addresses[i] != nextAddresses[i])
+                for (uint32_t user : sectionAt(candidates, *layout, i).referenced_by)
+                    dirty[user] = 1;
+        }
+        addresses.swap(nextAddresses);
+        for (size_t idx = 0; idx < candidates.size(); idx++) {
+            if (dirty[idx]) {
+                relocateSection(candidates[idx], addresses, layout->stage2_base, images[idx].data(), true);
+                dirty[idx] = 0;
+            }
+        }
+        // Mixed again, so that it does not cancel out the hash of the same order.
+        uint64_t layoutHash = permutationHash(permutation);
+        relocationKey = zobristKey(layoutHash >> 32, layoutHash & UINT32_MAX);
+        builtPerm.clear();
+    }
+
+    // Build the flat binary for a candidate ordering (permutation) into the arena.
+    // The sections are concatenated in order; each section start is aligned properly.
+    // Sections are laid out at their real offsets, but only their folded image
+    // is appended to the arena; the estimated cost of the folded zeros is
+    // accumulated into foldedBits.
+    // The end offset of each segment (the prefix, then every section) is stored
+    // into segmentEnds, so that the compressor can checkpoint its state at section
+    // boundaries.
+    // The images are relocated by the last relocate() call.
+    // The arena is only rebuilt from the first section that moved since the
+    // previous build, whose offset is stored into unchanged. The prefix must be
+    // the same for all the evaluations of an engine.
+    void buildFlatBinary(const std::vector<SectionCandidate>& candidates,
+                         const std::vector<size_t>& permutation,
+                         const std::vector<uint8_t>& prefix) {
+        if (images.size() != candidates.size())
+            relocate(candidates, permutation);
+        layoutSections(candidates, *layout, permutation, nextAddresses);
+
+        size_t first = 0;
+        while (first < permutation.size() && first < builtPerm.size() && permutation[first] == builtPerm[first])
+            first++;
+        size_t segmentBase = prefix.empty() ? 0 : 1;
+        if (builtPerm.empty()) {
+            flat.assign(prefix.begin(), prefix.end());
+            segmentEnds.assign(segmentBase, prefix.size());
+        }
+        flat.resize(segmentBase + first > 0 ? segmentEnds[segmentBase + first - 1] : 0);
+        segmentEnds.resize(segmentBase + first);
+        unchanged = flat.size();
+        builtPerm = permutation;
+
+        foldedBits = 0;
+        for (size_t idx : permutation)
+            foldedBits += candidates[idx].folded_bits;
+        uint32_t end_address = layout->stage2_base;
+        if (first > 0)
+            end_address = nextAddresses[permutation[first - 1]] + candidates[permutation[first - 1]].size;
+        for (size_t k = first; k < permutation.size(); k++) {
+            size_t idx = permutation[k];
+            const SectionCandidate& cand = candidates[idx];
+            const std::vector<uint8_t>& image = cand.relocs.empty() ? cand.image : images[idx];
+            // Pad up to the aligned address, then append the candidate section image.
+            flat.resize(flat.size() + (nextAddresses[idx] - end_address), 0);
+            flat.insert(flat.end(), image.begin(), image.end());
+            end_address = nextAddresses[idx] + cand.size;
+            segmentEnds.push_back(flat.size());
+        }
+    }
+
+    // Evaluate a candidate permutation by building the flat binary,
+    // sending it through upkr, and returning the estimated compressed size as cost.
+    // The cost is a fractional number of bytes, so that moves that change the
+    // encoding by less than a byte still steer the annealer.
+    // The incremental context only re-encodes the sections starting from the first
+    // one that differs from the last committed permutation (see commit()).
+    // If the permutation violates a placement rule, returns MAX_COST.
+    double evaluate(const std::vector<size_t>& permutation,
+                    const std::vector<SectionCandidate>& candidates,
+                    const std::vector<uint8_t>& prefix) {
+        uint64_t start = nanoTime();
+        bool valid = checkConstraints(candidates, permutation, layout->stage2_base);
+        uint64_t built = nanoTime();
+        constraintNanos += built - start;
+        if (!valid)
+            return MAX_COST;
+        evaluations++;
+        stale = false;
+        buildFlatBinary(candidates, permutation, prefix);
+        start = built;
+        built = nanoTime();
+        buildNanos += built - start;
+        double bits = upkr_incremental_eval_from(ctx, flat.data(), flat.size(),
+                segmentEnds.data(), segmentEnds.size(), unchanged);
+        evaluatedBytes += flat.size();
+        reencodedBytes += flat.size() - upkr_incremental_restart_offset(ctx);
+        compressNanos += nanoTime() - built;
+        return (bits + foldedBits) / 8.0;
+    }
+
+    // Same as evaluate(), but first look up the permutation (given its hash) in the
+    // transposition cache, and store the result there on a miss.
+    double evaluate(const std::vector<size_t>& permutation,
+                    uint64_t permutationHash,
+                    const std::vector<SectionCandidate>& candidates,
+                    const std::vector<uint8_t>& prefix) {
+        double cost;
+        // The cost depends on the layout the images were relocated for.
+        uint64_t key = permutationHash ^ relocationKey;
+        if (cache && cache->lookup(key, cost)) {
+            cache_hits++;
+            stale = true;
+            return cost;
+        }
+        cost = evaluate(permutation, candidates, prefix);
+        if (cache && cost != MAX_COST)
+            cache->store(key, cost);
+        return cost;
+    }
+
+    // Exact compressed size in (fractional) bytes of the real binary of a
+    // permutation (the prefix, then the linked stage 2, see linkStage2()),
+    // as produced by upkr at the given level.
+    // The binary is built into the arena, so the next build starts from scratch.
+    double exactCost(const std::vector<size_t>& permutation,
+                     const std::vector<SectionCandidate>& candidates,
+                     const std::vector<uint8_t>& prefix,
+                     int level) {
+        std::vector<uint8_t> stage2 = linkStage2(candidates, *layout, permutation);
+        builtPerm.clear();
+        flat.assign(prefix.begin(), prefix.end());
+        flat.insert(flat.end(), stage2.begin(), stage2.end());
+        return upkr_context_cost(packer, flat.data(), flat.size(), level) / 8.0;
+    }
+
+    // Make the last evaluated permutation the base for the following evaluations.
+    // If its cost came from the cache, the compressor has not seen it yet, so it
+    // is evaluated now.
+    void commit(const std::vector<size_t>& permutation,
+                const std::vector<SectionCandidate>& candidates,
+                const std::vector<uint8_t>& prefix) {
+        if (stale)
+            evaluate(permutation, candidates, prefix);
+        upkr_incremental_commit(ctx);
+    }
+};
+
+// -----------------------------------------------------------------------------
+// SIMULATED ANNEALING FUNCTIONS (MULTIPLE-ROUND APPROACH)
+// -----------------------------------------------------------------------------
+
+// Structure to hold one simulated annealing result.
+struct SAResult {
+    std::vector<size_t> best_permutation;
+    double best_cost = MAX_COST;
+};
+
+// Returns true if (cost, perm) is better than the best result found so far.
+// Ties on cost are broken on the permutation itself to keep results deterministic.
+inline bool isBetter(double cost, const std::vector<size_t>& perm, const SAResult& best) {
+    return cost < best.best_cost || (cost == best.best_cost && perm < best.best_permutation);
+}
+
+// Maximum number of moves drawn by annealStep() to find a feasible neighbour.
+const int MAX_MOVE_DRAWS = 16;
+
+// Try a random move on the engine's current permutation, and accept it with
+// the Metropolis criterion at the given temperature. The move operator is
+// chosen by the engine's adaptive selector, which is then rewarded with the outcome.
+// The move is applied in place on the engine's permutation arena and reverted
+// if rejected. Returns false if no feasible move was found: in that case the step
+// is discarded without temperature processing.
+bool annealStep(EvalEngine& engine, double& current_cost, double temperature,
+                std::mt19937& rng, SAResult& result,
+                const std::vector<SectionCandidate>& candidates,
+                const std::vector<uint8_t>& prefix) {
+    std::vector<size_t>& current_perm = engine.perm;
+    if (current_perm.size() < 2)
+        return false;
+    std::uniform_real_distribution<double> real_dist(0.0, 1.0);
+    engine.temperature.store(temperature, std::memory_order_relaxed);
+
+    // Sample only feasible neighbours: moves that break a placement rule are
+    // rejected by the O(n) constraint check and drawn again, without evaluating them.
+    MoveOp op;
+    Move move;
+    uint64_t new_hash;
+    int draws = 0;
+    for (;;) {
+        op = engine.selector.pick(rng);
+        move = op == MOVE_AFFINITY ? affinityMove(current_perm, *engine.affinity, rng)
+                                   : randomMove(op, current_perm.size(), rng);
+        engine.moveStats[op].tried++;
+        new_hash = engine.hash;
+        move.toggleHash(current_perm, new_hash);
+        move.apply(current_perm);
+        uint64_t start = nanoTime();
+        bool valid = checkConstraints(candidates, current_perm, engine.layout->stage2_base);
+        engine.constraintNanos += nanoTime() - start;
+        if (valid) {
+            move.toggleHash(current_perm, new_hash);
+            break;
+        }
+        move.revert(current_perm);
+        engine.moveStats[op].invalid++;
+        engine.selector.reward(op, 0);
+        if (++draws == MAX_MOVE_DRAWS)
+            return false;
+    }
+    MoveStats& stats = engine.moveStats[op];
+
+    double new_cost = engine.evaluate(current_perm, new_hash, candidates, prefix);
+    assert(new_cost != MAX_COST);
+    double delta = new_cost - current_cost;
+    if (new_cost < current_cost || real_dist(rng) < std::exp(-delta / temperature)) {
+        stats.accepted++;
+        if (new_cost < current_cost)
+            stats.improved++;
+        engine.selector.reward(op, new_cost < current_cost ?
+            MoveSelector::REWARD_IMPROVED : MoveSelector::REWARD_ACCEPTED);
+        current_cost = new_cost;
+        engine.hash = new_hash;
+        engine.commit(current_perm, candidates, prefix);
+        if (isBetter(current_cost, current_perm, result)) {
+            result.best_cost = current_cost;
+            result.best_permutation = current_perm;
+            engine.chainBest.store(current_cost, std::memory_order_relaxed);
+        }
+    } else {
+        move.revert(current_perm);
+        engine.selector.reward(op, 0);
+    }
+    return true;
+}
+
+// Deterministic simulated annealing run starting from a given candidate ordering.
+// 'seed' is fixed for reproducibility. This algorithm works on permutation space.
+// Modification: if no feasible move is found, the step is discarded without temperature processing.
+SAResult runSAFromCandidate(
+    EvalEngine& engine,
+    const std::vector<size_t>& startCandidate,
+    const std::vector<SectionCandidate>& candidates,
+    const std::vector<uint8_t>& prefix,
+    int iterations,
+    double initial_temp,
+    double cooling_rate,
+    unsigned seed
+) {
+    SAResult result;
+    std::vector<size_t>& current_perm = engine.perm;
+    current_perm = startCandidate;
+    std::mt19937 rng(seed);
+    // The chain must only depend on its start and seed, whatever ran on this
+    // engine before: worker processes and threads run different chains.
+    engine.selector = MoveSelector();
+    engine.relocate(candidates, current_perm);
+
+    double current_cost = engine.evaluate(current_perm, candidates, prefix);
+    assert(current_cost != MAX_COST);
+    if (current_cost == MAX_COST) {
+        result.best_permutation = current_perm;
+        result.best_cost = MAX_COST;
+        return result;
+    }
+    engine.hash = permutationHash(current_perm);
+    engine.commit(current_perm, candidates, prefix);
+    double temperature = initial_temp;
+    result.best_permutation = current_perm;
+    result.best_cost = current_cost;
+    engine.chainBest.store(current_cost, std::memory_order_relaxed);
+
+    uint64_t allocations = heapAllocations();
+    for (int i = 0; i < iterations && !g_stop.load(); i++) {
+        if (!annealStep(engine, current_cost, temperature, rng, result, candidates, prefix))
+            continue;
+        temperature *= cooling_rate;
+    }
+    engine.steady_allocations += heapAllocations() - allocations;
+
+    return result;
+}
+
+void progressBar(int currentStep, int totalSteps, const std::string& status);
+
+// State of a parallel tempering run, saved in checkpoints to resume it.
+// The current ordering of each replica is the permutation of its engine.
+struct TemperingState {
+    int epoch = 0;                      // Completed epochs
+    std::vector<int> replicaAt;         // Replica currently at each ladder level
+    std::vector<SAResult> results;      // Best result of each replica
+    std::vector<std::mt19937> rngs;     // RNG of each replica
+    std::mt19937 exchangeRng;           // RNG deciding the exchanges
+    int exchanges = 0, attempts = 0;    // Exchange statistics
+};
+
+// Initialize a parallel tempering run where all replicas start from the same ordering.
+void startTempering(TemperingState& state, std::vector<EvalEngine>& engines,
+                    const std::vector<size_t>& startCandidate, unsigned seed) {
+    int replicas = engines.size();
+    state = TemperingState();
+    for (int r = 0; r < replicas; r++) {
+        engines[r].perm = startCandidate;
+        state.replicaAt.push_back(r);
+        state.results.push_back(SAResult{startCandidate, MAX_COST});
+        state.rngs.emplace_back(seed + r);
+    }
+    state.exchangeRng.seed(seed + replicas);
+}
+
+// Parallel tempering (replica exchange), running from the given state up to
+// the given number of epochs.
+// One replica per engine runs Metropolis sweeps at a fixed temperature, taken
+// from a geometric ladder between t_min and t_max. After each epoch, replicas at
+// neighbouring temperatures are exchanged with probability
+// min(1, exp((1/T_cold - 1/T_hot) * (E_cold - E_hot))), so that orderings found
+// by the hot replicas migrate down to the cold ones instead of being thrown away.
+// Each replica has its own RNG and exchanges are decided in a fixed order by a
+// separate RNG, so results only depend on the seed and the parameters.
+// onEpoch is called with the best result so far after each completed epoch.
+SAResult runParallelTempering(
+    std::vector<EvalEngine>& engines,
+    TemperingState& state,
+    const std::vector<SectionCandidate>& candidates,
+    const std::vector<uint8_t>& prefix,
+    int epochs,
+    int sweep,
+    double t_min,
+    double t_max,
+    const std::function<void(const SAResult&)>& onEpoch
+) {
+    int replicas = engines.size();
+    std::vector<double> ladder(replicas);       // Temperature of each ladder level
+    std::vector<double> costs(replicas);        // Current cost of each replica
+    for (int r = 0; r < replicas; r++)
+        ladder[r] = replicas > 1 ? t_min * std::pow(t_max / t_min, double(r) / (replicas - 1)) : t_max;
+    std::uniform_real_distribution<double> real_dist(0.0, 1.0);
+    std::vector<SAResult>& results = state.results;
+
+    // Relocate the images of each replica for its current order, and score it
+    // again with them (see EvalEngine::relocate()).
+    auto relocate = [&](int r) {
+        engines[r].relocate(candidates, engines[r].perm);
+        costs[r] = engines[r].evaluate(engines[r].perm, candidates, prefix);
+        engines[r].hash = permutationHash(engines[r].perm);
+        engines[r].commit(engines[r].perm, candidates, prefix);
+        if (isBetter(costs[r], engines[r].perm, results[r]))
+            results[r] = SAResult{engines[r].perm, costs[r]};
+        engines[r].chainBest.store(results[r].best_cost, std::memory_order_relaxed);
+    };
+    ThreadPool::global().parallelFor(replicas, relocate);
+    bool relocated = true;
+    assert(costs[0] != MAX_COST);
+
+    auto bestResult = [&]() {
+        SAResult best = results[0];
+        for (int r = 1; r < replicas; r++)
+            if (isBetter(results[r].best_cost, results[r].best_permutation, best))
+                best = results[r];
+        return best;
+    };
+
+    while (state.epoch < epochs && !g_stop.load()) {
+        progressBar(state.epoch, epochs, "Tempering... (" + std::to_string(int(std::ceil(bestResult().best_cost))) + " bytes)");
+
+        if (!relocated)
+            ThreadPool::global().parallelFor(replicas, relocate);
+        relocated = false;
+        ThreadPool::global().parallelFor(replicas, [&](int level) {
+            int r = state.replicaAt[level];
+            uint64_t allocations = heapAllocations();
+            for (int i = 0; i < sweep && !g_stop.load(); i++)
+                annealStep(engines[r], costs[r], ladder[level], state.rngs[r], results[r], candidates, prefix);
+            engines[r].steady_allocations += heapAllocations() - allocations;
+        });
+        if (g_stop.load())
+            break;
+
+        // Exchange between neighbouring levels, alternating even and odd pairs.
+        for (int level = state.epoch % 2; level + 1 < replicas; level += 2) {
+            int cold = state.replicaAt[level], hot = state.replicaAt[level + 1];
+            double x = (1.0 / ladder[level] - 1.0 / ladder[level + 1]) * (costs[cold] - costs[hot]);
+            state.attempts++;
+            if (x >= 0 || real_dist(state.exchangeRng) < std::exp(x)) {
+                std::swap(state.replicaAt[level], state.replicaAt[level + 1]);
+                state.exchanges++;
+            }
+        }
+        state.epoch++;
+        onEpoch(bestResult());
+    }
+
+    std::cerr << "\r                                                                \r";
+    std::cerr << "swizzle3: tempering accepted " << state.exchanges << "/" << state.attempts << " exchanges\n";
+    return bestResult();
+}
+
+void progressBar(int currentStep, int totalSteps, const std::string& status) {
+    static int spinnerIndex = 0;
+    const char spinnerChars[] = { '|', '/', '-', '\\' };
+    const int barLength = 10;
+    
+    double progressFraction = static_cast<double>(currentStep) / totalSteps;
+    int filledLength = static_cast<int>(progressFraction * barLength);
+    
+    std::string bar = "[";
+    for (int i = 0; i < filledLength; ++i) {
+        bar += "█";
+    }
+    for (int i = filledLength; i < barLength; ++i) {
+        bar += "░";
+    }
+    bar += "]";
+    
+    char spinner = spinnerChars[spinnerIndex % 4];
+    spinnerIndex++;
+    
+    std::cerr << "\r" << bar << " " << currentStep << "/" << totalSteps << " " << status << " " << spinner;
+    std::cerr.flush();
+}
+
+// -----------------------------------------------------------------------------
+// MULTI-FIDELITY CONFIRMATION
+// -----------------------------------------------------------------------------
+
+// The annealing screens orderings with the incremental estimator, which follows
+// compression level 1. The final binary is compressed at a higher level, whose
+// parser makes different choices, so an ordering that wins the screening can
+// lose at that level. The best orderings of the screening are thus re-scored
+// with the real compressor at the final level, and the best of them is the
+// result of the optimization.
+std::vector<size_t> collapseFragments(const std::vector<SectionCandidate>& candidates,
+                                      const std::vector<size_t>& permutation);
+
+struct Confirmer {
+    int level;                                      // Compression level of the final binary
+    int top_k;                                      // Orderings confirmed per batch
+    bool split = false;                             // Sections are split (see collapseFragments())
+    uint32_t base = 0;                              // Base address of stage 2, for the placement rules
+    std::unordered_map<uint64_t, double> costs{};   // Costs at 'level', by permutation hash
+    SAResult best{};                                // Best confirmed ordering
+    SAResult whole{};                               // Best confirmed valid order of the whole sections
+    int confirmations = 0;                          // Number of orderings re-scored
+
+    // Re-score the top_k distinct results (by screening cost) not confirmed yet,
+    // in parallel using the arenas of the engines, and update the best one.
+    // When sections are split, the order of the whole sections that the linker
+    // produces from each result is scored as well, if it follows the placement
+    // rules, and the best of them is kept apart for the order files.
+    void confirm(std::vector<SAResult> results,
+                 std::vector<EvalEngine>& engines,
+                 const std::vector<SectionCandidate>& candidates,
+                 const std::vector<uint8_t>& prefix) {
+        std::sort(results.begin(), results.end(), [](const SAResult& a, const SAResult& b) {
+            return isBetter(a.best_cost, a.best_permutation, b);
+        });
+        struct Order {
+            std::vector<size_t> perm;
+            bool result, whole;     // Candidate for best, for whole
+        };
+        std::vector<Order> todo;
+        std::vector<uint64_t> hashes;
+        auto add = [&](const std::vector<size_t>& perm, bool result, bool whole) {
+            uint64_t hash = permutationHash(perm);
+            for (size_t i = 0; i < todo.size(); i++) {
+                if (todo[i].perm == perm) {
+                    todo[i].result |= result;
+                    todo[i].whole |= whole;
+                    return;
+                }
+            }
+            if (!costs.count(hash))
+                todo.push_back(Order{perm, result, whole});
+        };
+        for (const SAResult& result : results) {
+            if (int(hashes.size()) == std::min(top_k, int(engines.size())))
+                break;
+            uint64_t hash = permutationHash(result.best_permutation);
+            if (std::find(hashes.begin(), hashes.end(), hash) != hashes.end())
+                continue;
+            hashes.push_back(hash);
+            if (!split) {
+                add(result.best_permutation, true, true);
+                continue;
+            }
+            add(result.best_permutation, true, false);
+            std::vector<size_t> collapsed = collapseFragments(candidates, result.best_permutation);
+            if (checkConstraints(candidates, collapsed, base))
+                add(collapsed, false, true);
+        }
+
+        std::vector<double> exact(todo.size());
+        size_t workers = std::min(todo.size(), engines.size());
+        ThreadPool::global().parallelFor(workers, [&](int e) {
+            for (size_t i = e; i < todo.size(); i += workers)
+                exact[i] = engines[e].exactCost(todo[i].perm, candidates, prefix, level);
+        });
+        for (size_t i = 0; i < todo.size(); i++) {
+            costs[permutationHash(todo[i].perm)] = exact[i];
+            confirmations++;
+            if (todo[i].result && (best.best_permutation.empty() || isBetter(exact[i], todo[i].perm, best)))
+                best = SAResult{todo[i].perm, exact[i]};
+            if (todo[i].whole && (whole.best_permutation.empty() || isBetter(exact[i], todo[i].perm, whole)))
+                whole = SAResult{todo[i].perm, exact[i]};
+        }
+    }
+};
+
+// -----------------------------------------------------------------------------
+// TELEMETRY
+// -----------------------------------------------------------------------------
+
+// Interval between the records of the telemetry trace.
+const int TRACE_INTERVAL_MS = 1000;
+
+// Snapshot of the counters of an engine.
+struct EngineSample {
+    uint64_t evaluations = 0, cacheHits = 0;
+    uint64_t buildNanos = 0, compressNanos = 0, constraintNanos = 0;
+    uint64_t tried = 0, invalid = 0, accepted = 0;
+    uint64_t evaluatedBytes = 0, reencodedBytes = 0;
+
+    explicit EngineSample(const EvalEngine& engine) :
+        evaluations(engine.evaluations), cacheHits(engine.cache_hits),
+        buildNanos(engine.buildNanos), compressNanos(engine.compressNanos),
+        constraintNanos(engine.constraintNanos),
+        evaluatedBytes(engine.evaluatedBytes), reencodedBytes(engine.reencodedBytes) {
+        for (const MoveStats& stats : engine.moveStats) {
+            tried += stats.tried;
+            invalid += stats.invalid;
+            accepted += stats.accepted;
+        }
+    }
+    EngineSample() = default;
+};
+
+// Telemetry of an optimization run, to tune the annealing parameters.
+// With a trace file, a background thread samples the counters of the engines
+// every TRACE_INTERVAL_MS and writes one record per engine, with the figures
+// of the last interval: evaluations and cache hits (and evaluations per second),
+// seconds spent building binaries, compressing and checking placement rules,
+// the ratio of invalid moves over the generated ones, the acceptance ratio of
+// the valid ones, the temperature, the best cost of the current chain and the
+// best confirmed cost. The trace is CSV if the file name ends in .csv, and JSON
+// Lines (one object per record) otherwise.
+struct Telemetry {
+    const std::vector<EvalEngine>& engines;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::atomic<double> best{MAX_COST};     // Best confirmed cost
+    std::ofstream out;
+    bool csv = false;
+    std::vector<EngineSample> last;         // Counters at the last record
+    double lastTime = 0;
+    std::thread sampler;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    bool stopping = false;
+
+    explicit Telemetry(const std::vector<EvalEngine>& engines) : engines(engines), last(engines.size()) {}
+    ~Telemetry() { stop(); }
+
+    double elapsed() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Start writing the trace to path.
+    bool trace(const std::string& path) {
+        out.open(path);
+        if (!out)
+            return false;
+        csv = path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0;
+        if (csv)
+            out << "time,engine,evaluations,evaluations_per_sec,cache_hits,build_sec,compress_sec,"
+                   "constraint_sec,invalid_ratio,acceptance_ratio,temperature,chain_best,best\n";
+        sampler = std::thread([this]() {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (!wakeup.wait_for(lock, std::chrono::milliseconds(TRACE_INTERVAL_MS),
+                                    [this]() { return stopping; }))
+                record();
+        });
+        return true;
+    }
+
+    // Write a record per engine, for the interval since the last one.
+    void record() {
+        double now = elapsed(), interval = std::max(now - lastTime, 1e-9);
+        auto number = [](double x) {
+            std::ostringstream ss;
+            if (std::isfinite(x))
+                ss << std::setprecision(6) << x;
+            else
+                ss << "null";
+            return ss.str();
+        };
+        for (size_t e = 0; e < engines.size(); e++) {
+            EngineSample sample(engines[e]);
+            const EngineSample& prev = last[e];
+            uint64_t evaluations = sample.evaluations - prev.evaluations;
+            uint64_t valid = (sample.tried - prev.tried) - (sample.invalid - prev.invalid);
+            std::pair<const char*, std::string> fields[] = {
+                { "time", number(now) },
+                { "engine", std::to_string(e) },
+                { "evaluations", std::to_string(evaluations) },
+                { "evaluations_per_sec", number(evaluations / interval) },
+                { "cache_hits", std::to_string(sample.cacheHits - prev.cacheHits) },
+                { "build_sec", number((sample.buildNanos - prev.buildNanos) * 1e-9) },
+                { "compress_sec", number((sample.compressNanos - prev.compressNanos) * 1e-9) },
+                { "constraint_sec", number((sample.constraintNanos - prev.constraintNanos) * 1e-9) },
+                { "invalid_ratio", sample.tried > prev.tried ?
+                    number(double(sample.invalid - prev.invalid) / (sample.tried - prev.tried)) : "null" },
+                { "acceptance_ratio", valid ? number(double(sample.accepted - prev.accepted) / valid) : "null" },
+                { "temperature", number(engines[e].temperature.load(std::memory_order_relaxed)) },
+                { "chain_best", number(engines[e].chainBest.load(std::memory_order_relaxed)) },
+                { "best", number(best.load()) },
+            };
+            const char* separator = csv ? "" : "{";
+            for (const auto& [name, value] : fields) {
+                out << separator;
+                if (!csv)
+                    out << "\"" << name << "\":";
+                out << (csv && value == "null" ? "" : value);
+                separator = ",";
+            }
+            out << (csv ? "\n" : "}\n");
+            last[e] = sample;
+        }
+        out.flush();
+        lastTime = now;
+    }
+
+    // Write the last record and stop the trace.
+    void stop() {
+        if (!sampler.joinable())
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeup.notify_all();
+        sampler.join();
+        record();
+    }
+
+    // Print the per-engine totals of the run (--stats).
+    void summary() const {
+        double wall = elapsed();
+        auto seconds = [](uint64_t nanos) { return nanos * 1e-9; };
+        std::cerr << "swizzle3: stats over " << std::fixed << std::setprecision(1) << wall << " s\n"
+                  << "swizzle3:  engine  evals   evals/s   build%  compress%  constraint%  reencoded%  invalid%  accepted%  temperature\n";
+        EngineSample total;
+        for (size_t e = 0; e <= engines.size(); e++) {
+            EngineSample sample;
+            if (e < engines.size()) {
+                sample = EngineSample(engines[e]);
+                total.evaluations += sample.evaluations;
+                total.buildNanos += sample.buildNanos;
+                total.compressNanos += sample.compressNanos;
+                total.constraintNanos += sample.constraintNanos;
+                total.tried += sample.tried;
+                total.invalid += sample.invalid;
+                total.accepted += sample.accepted;
+                total.evaluatedBytes += sample.evaluatedBytes;
+                total.reencodedBytes += sample.reencodedBytes;
+            } else {
+                sample = total;
+            }
+            // Shares of the wall time of the engine (of all engines for the total).
+            double time = wall * (e < engines.size() ? 1 : engines.size());
+            uint64_t valid = sample.tried - sample.invalid;
+            std::cerr << "swizzle3:  " << std::setw(6) << (e < engines.size() ? std::to_string(e) : "total")
+                      << std::setw(7) << sample.evaluations
+                      << std::setw(10) << sample.evaluations / wall
+                      << std::setw(9) << 100 * seconds(sample.buildNanos) / time
+                      << std::setw(11) << 100 * seconds(sample.compressNanos) / time
+                      << std::setw(13) << 100 * seconds(sample.constraintNanos) / time
+                      << std::setw(12) << (sample.evaluatedBytes ? 100.0 * sample.reencodedBytes / sample.evaluatedBytes : 0.0)
+                      << std::setw(10) << (sample.tried ? 100.0 * sample.invalid / sample.tried : 0.0)
+                      << std::setw(11) << (valid ? 100.0 * sample.accepted / valid : 0.0);
+            if (e < engines.size())
+                std::cerr << std::setw(13) << std::setprecision(4) << engines[e].temperature.load()
+                          << std::setprecision(1);
+            std::cerr << "\n";
+        }
+        std::cerr << std::defaultfloat;
+    }
+};
+
+// -----------------------------------------------------------------------------
+// OUTPUT AND CHECKPOINTS
+// -----------------------------------------------------------------------------
+
+// Write a file atomically: write a temporary file next to it, then rename it over
+// the destination, so that an interrupted run never leaves a truncated file.
+bool writeFileAtomic(const std::string& path, const std::string& contents) {
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream ofs(tmp, std::ios::binary);
+        if (!ofs || !ofs.write(contents.data(), contents.size()))
+            return false;
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    return !ec;
+}
+
+// Order of the whole sections of a permutation of split sections: the linker
+// cannot reorder the contents of a section, so each section is placed where its
+// first fragment is, with all its fragments in offset order (see --link).
+std::vector<size_t> collapseFragments(const std::vector<SectionCandidate>& candidates,
+                                      const std::vector<size_t>& permutation) {
+    std::vector<size_t> whole;
+    whole.reserve(permutation.size());
+    for (size_t idx : permutation) {
+        if (candidates[idx].fragment_offset != 0)
+            continue;
+        whole.push_back(idx);
+        for (size_t next = idx + 1; next < candidates.size() && candidates[next].fragment_offset != 0; next++)
+            whole.push_back(next);
+    }
+    return whole;
+}
+
+// Write the section order as a linker script fragment, with its cost in a comment.
+// Output format: *(file_name(section_name)) for each candidate section.
+// Fragments of split sections other than the first one are not listed, so the
+// permutation and its cost must be those of collapseFragments().
+bool writeOrder(const std::string& path,
+                const std::vector<SectionCandidate>& candidates,
+                const std::vector<size_t>& permutation,
+                double cost) {
+    std::ostringstream ofs;
+    ofs << "/* Optimized Section Order - Include in Linker Script */\n";
+    ofs << "/* Compressed size: " << std::fixed << std::setprecision(2) << cost << " bytes */\n";
+    for (size_t idx : permutation) {
+        const SectionCandidate& cand = candidates[idx];
+        if (cand.fragment_offset != 0) {
+            continue;
+        } else if (cand.section_name == ".text.demo") {
+            ofs << "__stage2_entrypoint = .;\n";
+            ofs << "KEEP(" << cand.file_name << "(" << cand.section_name << "))" << "\n";
+        } else {
+            ofs << cand.file_name << "(" << cand.section_name << ")" << "\n";
+        }
+    }
+    return writeFileAtomic(path, ofs.str());
+}
+
+// Read a section order written by writeOrder(), and map it onto the candidates.
+// Entries of sections that don't exist anymore are dropped. Candidates missing
+// from the order (new sections) are inserted right after the candidate that
+// precedes them in the default ordering, so that they land next to similar
+// sections. Split sections are mapped onto all their fragments, in offset order.
+// The cost stored by writeOrder() is returned in cost, if present.
+// Returns false if the file cannot be read.
+bool readOrder(const std::string& path,
+               const std::vector<SectionCandidate>& candidates,
+               std::vector<size_t>& permutation,
+               size_t& dropped, size_t& added,
+               double& cost) {
+    std::ifstream ifs(path);
+    if (!ifs)
+        return false;
+    std::unordered_map<std::string, size_t> index;
+    for (size_t i = 0; i < candidates.size(); i++)
+        index[sectionKey(candidates[i])] = i;
+
+    std::vector<bool> placed(candidates.size());
+    permutation.clear();
+    dropped = added = 0;
+    cost = MAX_COST;
+    std::string line;
+    while (std::getline(ifs, line)) {
+        line.erase(0, line.find_first_not_of(" \t"));
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+        if (line.rfind("/* Compressed size: ", 0) == 0)
+            cost = std::strtod(line.c_str() + 20, nullptr);
+        if (line.empty() || line.rfind("/*", 0) == 0 || line.find('=') != std::string::npos)
+            continue;
+        if (line.rfind("KEEP(", 0) == 0 && line.back() == ')')
+            line = line.substr(5, line.size() - 6);
+        auto it = index.find(line);
+        if (it == index.end() || placed[it->second]) {
+            dropped++;
+            continue;
+        }
+        placed[it->second] = true;
+        permutation.push_back(it->second);
+        for (size_t next = it->second + 1; next < candidates.size() &&
+             candidates[next].fragment_offset != 0 && !placed[next]; next++) {
+            placed[next] = true;
+            permutation.push_back(next);
+        }
+    }
+    for (size_t idx = 0; idx < candidates.size(); idx++) {
+        if (placed[idx])
+            continue;
+        auto pos = idx == 0 ? permutation.begin() :
+            std::find(permutation.begin(), permutation.end(), idx - 1) + 1;
+        permutation.insert(pos, idx);
+        added++;
+    }
+    return true;
+}
+
+// Write the linked stage 2 of an ordering (see linkStage2()).
+bool writeLink(const std::string& path,
+               const std::vector<SectionCandidate>& candidates,
+               const StageLayout& layout,
+               const std::vector<size_t>& permutation) {
+    std::vector<uint8_t> binary = linkStage2(candidates, layout, permutation);
+    return writeFileAtomic(path, std::string(binary.begin(), binary.end()));
+}
+
+// Check the built-in linker against GNU ld: link the order in orderPath, and
+// compare it byte for byte with the stages of the ELF linked by small.1.ld from
+// the same inputs and order. Mismatches are reported with the section they fall in.
+bool verifyLink(const std::string& elfPath, const std::string& orderPath,
+                const std::vector<SectionCandidate>& candidates,
+                const StageLayout& layout) {
+    std::vector<size_t> permutation;
+    size_t dropped, added;
+    double cost;
+    if (!readOrder(orderPath, candidates, permutation, dropped, added, cost)) {
+        std::cerr << "verify: cannot read " << orderPath << "\n";
+        return false;
+    }
+    if (dropped || added)
+        std::cerr << "verify: warning: " << orderPath << " does not match the inputs ("
+                  << added << " sections missing, " << dropped << " unknown)\n";
+
+    ELFIO::elfio reader;
+    if (!reader.load(elfPath)) {
+        std::cerr << "verify: cannot load " << elfPath << "\n";
+        return false;
+    }
+    std::vector<uint8_t> expected;
+    uint32_t stage1_size = 0;
+    for (const auto& sec : reader.sections) {
+        if (sec->get_name() == ".text.stage1")
+            stage1_size = sec->get_size();
+        if (sec->get_name() != ".text.stage2" && sec->get_name() != ".text.stage2u")
+            continue;
+        if (sec->get_type() == ELFIO::SHT_NOBITS || !sec->get_data())
+            expected.resize(expected.size() + sec->get_size(), 0);
+        else
+            expected.insert(expected.end(), sec->get_data(), sec->get_data() + sec->get_size());
+    }
+    bool ok = true;
+    if (align_up(stage1_size, STAGE_ALIGNMENT) != layout.stage1_size) {
+        std::cerr << "verify: stage 1 is " << stage1_size << " bytes in " << elfPath
+                  << ", " << layout.stage1_size << " in the inputs\n";
+        ok = false;
+    }
+
+    std::vector<uint8_t> linked = linkStage2(candidates, layout, permutation);
+    if (linked.size() != expected.size()) {
+        std::cerr << "verify: stage 2 is " << expected.size() << " bytes in " << elfPath
+                  << ", " << linked.size() << " when linked\n";
+        ok = false;
+    }
+    if (ok && linked == expected) {
+        std::cerr << "verify: OK (" << linked.size() << " bytes identical)\n";
+        return true;
+    }
+
+    // Report the first mismatching byte of every section.
+    std::vector<uint32_t> addresses(candidates.size() + layout.size());
+    uint32_t stage2_size = layoutSections(candidates, layout, permutation, addresses) - layout.stage2_base;
+    uint32_t stage2u_start = UNCACHED_ADDRESS + layout.stage1_size + stage2_size;
+    std::vector<size_t> order = permutation;
+    for (size_t i = candidates.size() + layout.stage1.size(); i < addresses.size(); i++)
+        order.push_back(i);
+    int mismatches = 0;
+    for (size_t idx : order) {
+        const SectionCandidate& sec = sectionAt(candidates, layout, idx);
+        size_t offset = idx < candidates.size() ? addresses[idx] - layout.stage2_base :
+            stage2_size + addresses[idx] - stage2u_start;
+        for (size_t k = offset; k < offset + sec.size && k < linked.size(); k++) {
+            if (k >= expected.size() || linked[k] != expected[k]) {
+                std::cerr << "verify: " << sec.file_name << "(" << sec.section_name << ")+0x"
+                          << std::hex << k - offset << ": 0x" << int(linked[k]) << " linked, ";
+                if (k < expected.size())
+                    std::cerr << "0x" << int(expected[k]);
+                else
+                    std::cerr << "missing";
+                std::cerr << std::dec << " in " << elfPath << "\n";
+                mismatches++;
+                break;
+            }
+        }
+    }
+    if (mismatches == 0) {
+        auto diff = std::mismatch(linked.begin(), linked.end(), expected.begin(), expected.end());
+        if (diff.first != linked.end() && diff.second != expected.end())
+            std::cerr << "verify: padding differs at offset 0x" << std::hex
+                      << diff.first - linked.begin() << std::dec << "\n";
+    }
+    std::cerr << "verify: FAILED (" << mismatches << " sections differ)\n";
+    return false;
+}
+
+// Fingerprint (64-bit FNV-1a) of an optimization problem: the sections with their
+// contents and placement rules, the prefix, and a description of the parameters.
+uint64_t problemFingerprint(const std::vector<SectionCandidate>& candidates,
+                            const StageLayout& layout,
+                            const std::vector<uint8_t>& prefix,
+                            const std::string& params) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    auto add = [&](const void* data, size_t size) {
+        for (size_t i = 0; i < size; i++)
+            hash = (hash ^ static_cast<const uint8_t*>(data)[i]) * 0x100000001b3ull;
+    };
+    auto addString = [&](const std::string& str) { add(str.c_str(), str.size() + 1); };
+    for (size_t i = 0; i < candidates.size() + layout.size(); i++) {
+        const SectionCandidate& cand = sectionAt(candidates, layout, i);
+        addString(cand.file_name);
+        addString(cand.section_name);
+        uint32_t fields[] = { cand.alignment, cand.size, cand.fragment_offset, cand.nobits, cand.gp_relative,
+                              cand.region_start, cand.region_end,
+                              uint32_t(cand.pin), uint32_t(cand.follows) };
+        add(fields, sizeof(fields));
+        add(cand.data.data(), cand.data.size());
+        for (const Relocation& rel : cand.relocs) {
+            int64_t relFields[] = { rel.offset, rel.type, rel.target, rel.addend };
+            add(relFields, sizeof(relFields));
+        }
+    }
+    add(prefix.data(), prefix.size());
+    addString(params);
+    return hash;
+}
+
+// Binary checkpoint of the optimizer state. Integers are stored as little
+// endian 64-bit words, RNGs in their standard text representation.
+const char CHECKPOINT_MAGIC[8] = { 'S', 'W', 'Z', '3', 'C', 'K', 'P', '2' };
 
-// Fixed load address when building the flat binary.
-const uint32_t LOAD_ADDRESS = 0x80000000;
+struct CheckpointWriter {
+    std::string out;
 
-// A constant representing failure.
-const size_t MAX_COST = std::numeric_limits<size_t>::max();
+    void u64(uint64_t v) {
+        for (int i = 0; i < 8; i++)
+            out.push_back(char(v >> (i * 8)));
+    }
+    void f64(double v) { u64(std::bit_cast<uint64_t>(v)); }
+    void str(const std::string& v) { u64(v.size()); out += v; }
+    void perm(const std::vector<size_t>& v) {
+        u64(v.size());
+        for (size_t x : v) u64(x);
+    }
+    void rng(const std::mt19937& v) {
+        std::ostringstream ss;
+        ss << v;
+        str(ss.str());
+    }
+};
 
-// Global constants for gp-relative rule:
-const uint32_t GP_RELATIVE_MAX_OFFSET = 65536;    // They must be fully contained within the first 65536 bytes.
+struct CheckpointReader {
+    std::string in;
+    size_t pos = 0;
+    bool ok = true;
 
-// Global flag for graceful termination (CTRL+C).
-std::atomic<bool> g_stop{false};
-void signalHandler(int signum) {
-    g_stop.store(true);
+    uint64_t u64() {
+        if (in.size() - pos < 8) {
+            ok = false;
+            return 0;
+        }
+        uint64_t v = 0;
+        for (int i = 0; i < 8; i++)
+            v |= uint64_t(uint8_t(in[pos++])) << (i * 8);
+        return v;
+    }
+    double f64() { return std::bit_cast<double>(u64()); }
+    std::string str() {
+        uint64_t size = u64();
+        if (!ok || in.size() - pos < size) {
+            ok = false;
+            return "";
+        }
+        pos += size;
+        return in.substr(pos - size, size);
+    }
+    // Read a permutation of n elements, validating it.
+    std::vector<size_t> perm(size_t n) {
+        std::vector<size_t> v;
+        if (u64() != n) {
+            ok = false;
+            return v;
+        }
+        std::vector<bool> seen(n);
+        for (size_t i = 0; i < n && ok; i++) {
+            v.push_back(u64());
+            if (v.back() >= n || seen[v.back()])
+                ok = false;
+            else
+                seen[v.back()] = true;
+        }
+        return v;
+    }
+    void rng(std::mt19937& v) {
+        std::istringstream ss(str());
+        ss >> v;
+        if (ss.fail())
+            ok = false;
+    }
+};
+
+// Serialize the state of the optimizer: the number of completed steps (rounds or
+// epochs), the best result so far and the best order of the whole sections
+// (see Confirmer), the state of each engine (current ordering and move
+// selector), and the tempering state if any.
+std::string saveCheckpoint(uint64_t fingerprint, int step, const SAResult& best, const SAResult& whole,
+                           const std::vector<EvalEngine>& engines,
+                           const TemperingState* tempering) {
+    CheckpointWriter w;
+    w.out.assign(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+    w.u64(fingerprint);
+    w.u64(step);
+    w.perm(best.best_permutation);
+    w.f64(best.best_cost);
+    w.perm(whole.best_permutation);
+    w.f64(whole.best_cost);
+    w.u64(engines.size());
+    for (const EvalEngine& engine : engines) {
+        w.perm(engine.perm);
+        for (double q : engine.selector.quality)
+            w.f64(q);
+    }
+    if (tempering) {
+        for (int level : tempering->replicaAt)
+            w.u64(level);
+        for (const SAResult& result : tempering->results) {
+            w.perm(result.best_permutation);
+            w.f64(result.best_cost);
+        }
+        for (const std::mt19937& rng : tempering->rngs)
+            w.rng(rng);
+        w.rng(tempering->exchangeRng);
+        w.u64(tempering->exchanges);
+        w.u64(tempering->attempts);
+    }
+    return w.out;
 }
 
-// -----------------------------------------------------------------------------
-// DATA STRUCTURE: Candidate Section
-// -----------------------------------------------------------------------------
+// Restore the state saved by saveCheckpoint(). Returns false if the checkpoint
+// is corrupted or was saved for a different problem (fingerprint), in which
+// case the state is left untouched.
+bool loadCheckpoint(const std::string& data, uint64_t fingerprint, size_t n,
+                    int& step, SAResult& best, SAResult& whole, std::vector<EvalEngine>& engines,
+                    TemperingState* tempering) {
+    CheckpointReader r{data};
+    if (data.compare(0, sizeof(CHECKPOINT_MAGIC), CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0)
+        return false;
+    r.pos = sizeof(CHECKPOINT_MAGIC);
+    if (r.u64() != fingerprint)
+        return false;
+    int newStep = r.u64();
+    SAResult newBest;
+    newBest.best_permutation = r.perm(n);
+    newBest.best_cost = r.f64();
+    SAResult newWhole;
+    newWhole.best_permutation = r.perm(n);
+    newWhole.best_cost = r.f64();
+    if (r.u64() != engines.size())
+        return false;
+    std::vector<std::vector<size_t>> perms;
+    std::vector<std::array<double, MOVE_COUNT>> qualities(engines.size());
+    for (size_t e = 0; e < engines.size() && r.ok; e++) {
+        perms.push_back(r.perm(n));
+        for (double& q : qualities[e])
+            q = r.f64();
+    }
+    TemperingState newTempering;
+    if (tempering) {
+        for (size_t e = 0; e < engines.size(); e++)
+            newTempering.replicaAt.push_back(r.u64());
+        for (size_t e = 0; e < engines.size() && r.ok; e++) {
+            SAResult result;
+            result.best_permutation = r.perm(n);
+            result.best_cost = r.f64();
+            newTempering.results.push_back(result);
+        }
+        newTempering.rngs.resize(engines.size());
+        for (std::mt19937& rng : newTempering.rngs)
+            r.rng(rng);
+        r.rng(newTempering.exchangeRng);
+        newTempering.exchanges = r.u64();
+        newTempering.attempts = r.u64();
+        newTempering.epoch = newStep;
+        std::vector<int> levels = newTempering.replicaAt;
+        std::sort(levels.begin(), levels.end());
+        for (size_t e = 0; e < levels.size(); e++)
+            if (levels[e] != int(e))
+                return false;
+    }
+    if (!r.ok || r.pos != data.size())
+        return false;
 
-// Structure representing a candidate section from an input ELF object file.
-struct SectionCandidate {
-    std::string file_name;      // The originating file (.o)
-    std::string section_name;   // Section name (e.g. ".text", ".data", ".bss", etc.)
-    uint32_t alignment;         // Required alignment (power of 2)
-    uint32_t size;              // Section size in bytes
-    std::vector<uint8_t> data;  // Section contents (for SHT_PROGBITS read from file; for SHT_NOBITS, a zero-filled buffer)
-    bool gp_relative;           // True if the section is GP-relative
-};
+    step = newStep;
+    best = newBest;
+    whole = newWhole;
+    for (size_t e = 0; e < engines.size(); e++) {
+        engines[e].perm = perms[e];
+        std::copy(qualities[e].begin(), qualities[e].end(), engines[e].selector.quality);
+    }
+    if (tempering)
+        *tempering = newTempering;
+    return true;
+}
 
 // -----------------------------------------------------------------------------
-// UTILITY FUNCTIONS
+// DISTRIBUTED WORKERS
 // -----------------------------------------------------------------------------
 
-// Align an offset upward to a given alignment.
-inline uint32_t align_up(uint32_t offset, uint32_t alignment) {
-    if (alignment == 0) return offset;
-    uint32_t rem = offset % alignment;
-    return (rem == 0) ? offset : offset + (alignment - rem);
+// With --workers, the annealing chains of each round run in worker processes
+// instead of threads: local ones are forked by the coordinator, and remote ones
+// (started with --connect on other machines, with the same inputs and options)
+// connect to the address given by --listen. The transport is a stream socket,
+// either a Unix domain socket ("unix:PATH") or TCP ("HOST:PORT"). The protocol
+// is not authenticated, so --listen=:PORT only accepts local connections and
+// listening on other interfaces needs an explicit host (see socket_utils.h).
+//
+// The protocol is made of text lines, an ordering being its cost followed by
+// the candidate indices:
+//   worker -> coordinator   HELLO <fingerprint>
+//   coordinator -> worker   BEST <ordering>         start of the next chains
+//   coordinator -> worker   CHAIN <id> <seed>       run a chain
+//   worker -> coordinator   RESULT <id> <evaluations> <ordering>
+//   coordinator -> worker   QUIT, or ERROR <message>
+// Workers pull a chain at a time; the coordinator pushes the new global best
+// to all workers whenever a round is confirmed. A chain only depends on its
+// start and seed, so the results are the same as running the round on threads.
+// When a worker is lost, its chain is handed to another one; when none is left,
+// the coordinator runs the remaining chains itself.
+
+// Poll interval of the coordinator, to notice CTRL+C.
+const int COORDINATOR_POLL_MS = 100;
+
+std::string formatOrdering(double cost, const std::vector<size_t>& perm) {
+    std::ostringstream ss;
+    ss << std::setprecision(17) << cost;
+    for (size_t idx : perm)
+        ss << " " << idx;
+    return ss.str();
 }
 
-// Build a flat binary buffer from a candidate ordering (permutation).
-// The sections are concatenated in order; each section start is aligned properly.
-// If any "gp-relative" section (".data" or ".bss" with size < GP_RELATIVE_THRESHOLD)
-// would be placed such that it extends beyond GP_RELATIVE_MAX_OFFSET, then an empty buffer is returned.
-std::vector<uint8_t> buildFlatBinaryBuffer(const std::vector<SectionCandidate>& candidates,
-                                             const std::vector<size_t>& permutation,
-                                             const std::vector<uint8_t>& prefix) {
-    std::vector<uint8_t> candidateBuffer;
-    uint32_t current_offset = 0;
-    for (size_t idx : permutation) {
-        const SectionCandidate& cand = candidates[idx];
-        // Align current offset to the candidate's required alignment.
-        current_offset = align_up(current_offset, cand.alignment);
-        // Check gp-relative rule: if candidate is gp-relative
-        // then it must be entirely within the first GP_RELATIVE_MAX_OFFSET bytes.
-        if (cand.gp_relative) {
-            if (current_offset + cand.size > GP_RELATIVE_MAX_OFFSET) {
-                // Permutation is invalid: return empty buffer.
-                return std::vector<uint8_t>();
-            }
-        }
-        // Expand the buffer if needed.
-        if (candidateBuffer.size() < current_offset)
-        candidateBuffer.resize(current_offset, 0);
-        // Append the candidate section data.
-        candidateBuffer.insert(candidateBuffer.end(), cand.data.begin(), cand.data.end());
-        current_offset += cand.size;
-    }
-    // Final flat binary: prefix (if any) concatenated with candidateBuffer.
-    std::vector<uint8_t> finalBuffer;
-    if (!prefix.empty()) {
-        finalBuffer = prefix;  // prefix is placed at beginning
-        finalBuffer.insert(finalBuffer.end(), candidateBuffer.begin(), candidateBuffer.end());
-    } else {
-        finalBuffer = candidateBuffer;
+// Parse an ordering of n candidates. Returns false if it is not a permutation.
+bool parseOrdering(std::istringstream& ss, size_t n, double& cost, std::vector<size_t>& perm) {
+    std::vector<uint8_t> seen(n, 0);
+    perm.resize(n);
+    if (!(ss >> cost))
+        return false;
+    for (size_t& idx : perm) {
+        if (!(ss >> idx) || idx >= n || seen[idx])
+            return false;
+        seen[idx] = 1;
     }
-    return finalBuffer;
+    return true;
 }
 
-// Evaluate a candidate permutation by building the flat binary,
-// sending it through upkr, and returning the compressed data size as cost.
-// If the flat binary is empty (i.e. invalid due to gp-relative rule), returns MAX_COST.
-size_t evaluatePermutation(const std::vector<size_t>& permutation,
-                           const std::vector<SectionCandidate>& candidates,
-                            const std::vector<uint8_t>& prefix) {
-    std::vector<uint8_t> flatBuffer = buildFlatBinaryBuffer(candidates, permutation, prefix);
-    if (flatBuffer.empty()) {
-        // Permutation is invalid because a gp-relative section lies outside its limit.
-        return MAX_COST;
+// Worker side: run the chains assigned by the coordinator on fd until told to
+// quit. Returns the process exit code.
+int runWorker(int fd, uint64_t fingerprint, EvalEngine& engine,
+              const std::vector<SectionCandidate>& candidates,
+              const std::vector<uint8_t>& prefix,
+              int iterations, double initial_temp, double cooling_rate) {
+    char hello[64];
+    snprintf(hello, sizeof(hello), "HELLO %016llx", (unsigned long long)fingerprint);
+    if (!sendLine(fd, hello))
+        return EXIT_FAILURE;
+    std::string buffer, line;
+    std::vector<size_t> start;
+    for (;;) {
+        while (!nextLine(buffer, line)) {
+            if (!receive(fd, buffer, true)) {
+                // Only QUIT ends the work cleanly.
+                std::cerr << "swizzle3: lost the connection to the coordinator\n";
+                return EXIT_FAILURE;
+            }
+        }
+        std::istringstream ss(line);
+        std::string cmd;
+        ss >> cmd;
+        double cost;
+        if (cmd == "BEST") {
+            if (!parseOrdering(ss, candidates.size(), cost, start))
+                return EXIT_FAILURE;
+        } else if (cmd == "CHAIN") {
+            uint64_t id;
+            unsigned seed;
+            if (!(ss >> id >> seed) || start.empty())
+                return EXIT_FAILURE;
+            uint64_t evaluations = engine.evaluations;
+            SAResult result = runSAFromCandidate(engine, start, candidates, prefix,
+                                                 iterations, initial_temp, cooling_rate, seed);
+            if (!sendLine(fd, "RESULT " + std::to_string(id) + " " +
+                              std::to_string(engine.evaluations - evaluations) + " " +
+                              formatOrdering(result.best_cost, result.best_permutation)))
+                return EXIT_FAILURE;
+        } else if (cmd == "QUIT") {
+            return EXIT_SUCCESS;
+        } else {
+            std::cerr << "swizzle3: coordinator: " << line << "\n";
+            return EXIT_FAILURE;
+        }
     }
-    std::vector<uint8_t> compressedOutput;
-    compressedOutput.resize(flatBuffer.size() * 2);
+}
 
-    size_t cost = upkr_compress(compressedOutput.data(), compressedOutput.size(), 
-            flatBuffer.data(), flatBuffer.size(), 1);
-    return cost;
+// Fork a local worker process running body() on one end of a socket pair.
+// Returns the coordinator end, or -1 on failure.
+int forkWorker(const std::function<int(int)>& body, pid_t& pid) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+        return -1;
+    pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        // The child only has this thread, so it must not touch the thread pool
+        // nor run the destructors of the parent's state.
+        close(fds[0]);
+        _exit(body(fds[1]));
+    }
+    close(fds[1]);
+    return fds[0];
 }
 
-// -----------------------------------------------------------------------------
-// SIMULATED ANNEALING FUNCTIONS (MULTIPLE-ROUND APPROACH)
-// -----------------------------------------------------------------------------
+// Coordinator side: hands out the chains of each round to the workers.
+struct Coordinator {
+    struct Worker {
+        int fd;
+        pid_t pid;              // Local worker process, or -1 if remote
+        std::string buffer{};   // Data received and not parsed yet
+        bool ready = false;     // Handshake done
+        int64_t chain = -1;     // Chain being run, or -1
+    };
 
-// Structure to hold one simulated annealing result.
-struct SAResult {
-    std::vector<size_t> best_permutation;
-    size_t best_cost = MAX_COST;
-};
+    uint64_t fingerprint;
+    size_t n;                   // Number of candidates
+    const std::vector<SectionCandidate>* candidates = nullptr; // To check the results
+    uint32_t base = 0;          // Base address of stage 2, for the placement rules
+    int listener = -1;          // Socket accepting remote workers, or -1
+    std::vector<Worker> workers;
+    std::string best;           // Last BEST line
+    uint64_t evaluations = 0;   // Evaluations done by the workers
+    int joined = 0, lost = 0, reassigned = 0;
 
-// Deterministic simulated annealing run starting from a given candidate ordering.
-// 'seed' is fixed for reproducibility. This algorithm works on permutation space.
-// Modification: if evaluatePermutation returns MAX_COST, we discard that candidate without temperature processing.
-SAResult runSAFromCandidate(
-    const std::vector<size_t>& startCandidate,
-    const std::vector<SectionCandidate>& candidates,
-    const std::vector<uint8_t>& prefix,
-    int iterations,
-    double initial_temp,
-    double cooling_rate,
-    unsigned seed
-) {
-    SAResult result;
-    std::vector<size_t> current_perm = startCandidate;
-    std::mt19937 rng(seed);
-    std::uniform_real_distribution<double> real_dist(0.0, 1.0);
-    std::uniform_int_distribution<size_t> index_dist(0, candidates.size() - 1);
+    void add(int fd, pid_t pid) {
+        workers.push_back(Worker{fd, pid});
+        joined++;
+    }
 
-    size_t current_cost = evaluatePermutation(current_perm, candidates, prefix);
-    assert(current_cost != MAX_COST);
-    if (current_cost == MAX_COST) {
-        result.best_permutation = current_perm;
-        result.best_cost = MAX_COST;
-        return result;
+    // Disconnect a worker, putting its chain back into the queue.
+    void drop(Worker& w, std::deque<int64_t>& queue) {
+        close(w.fd);
+        if (w.pid > 0) {
+            kill(w.pid, SIGTERM);
+            waitpid(w.pid, nullptr, 0);
+        }
+        if (w.chain >= 0) {
+            queue.push_front(w.chain);
+            reassigned++;
+        }
+        w.fd = -1;
+        w.ready = false;
+        w.chain = -1;
+        lost++;
     }
-    double temperature = initial_temp;
-    result.best_permutation = current_perm;
-    result.best_cost = current_cost;
 
-    for (int i = 0; i < iterations && !g_stop.load(); i++) {
-        std::vector<size_t> new_perm = current_perm;
-        size_t i1 = index_dist(rng);
-        size_t i2 = index_dist(rng);
-        std::swap(new_perm[i1], new_perm[i2]);
-
-        size_t new_cost = evaluatePermutation(new_perm, candidates, prefix);
-        // If the new candidate is invalid, skip the update.
-        if(new_cost == MAX_COST) {
-            continue;
+    // Handle a line from a worker. Returns false on protocol errors.
+    bool handle(Worker& w, const std::string& line, std::vector<SAResult>& results, size_t& done) {
+        std::istringstream ss(line);
+        std::string cmd;
+        ss >> cmd;
+        if (cmd == "HELLO" && !w.ready) {
+            uint64_t fp;
+            if (!(ss >> std::hex >> fp) || fp != fingerprint) {
+                sendLine(w.fd, "ERROR different inputs or options");
+                return false;
+            }
+            w.ready = true;
+            return best.empty() || sendLine(w.fd, best);
         }
-        int delta = int(new_cost) - int(current_cost);
-        if (new_cost < current_cost || real_dist(rng) < std::exp(-delta / temperature)) {
-            current_perm = new_perm;
-            current_cost = new_cost;
-            if (current_cost < result.best_cost ||
-               (current_cost == result.best_cost && current_perm < result.best_permutation))
-            {
-                result.best_cost = current_cost;
-                result.best_permutation = current_perm;
+        int64_t chain;
+        uint64_t evals;
+        SAResult result;
+        if (cmd == "RESULT" && ss >> chain >> evals && chain == w.chain &&
+            parseOrdering(ss, n, result.best_cost, result.best_permutation)) {
+            // The coordinator may adopt the result as its next start, so it
+            // must be a valid ordering whatever the worker did.
+            if (!checkConstraints(*candidates, result.best_permutation, base)) {
+                std::cerr << "\nswizzle3: chain " << chain << " result breaks the placement rules\n";
+                return false;
             }
+            results[chain] = result;
+            evaluations += evals;
+            w.chain = -1;
+            done++;
+            return true;
         }
-        temperature *= cooling_rate;
+        return false;
     }
 
-    return result;
-}
+    // Run one chain per seed from the given start, storing the results, in
+    // order. runLocal(i, seed) runs chain i in the coordinator, when no worker
+    // is left. Interrupted chains have no result (an empty ordering).
+    void runChains(const std::vector<size_t>& start, double cost, const std::vector<unsigned>& seeds,
+                   std::vector<SAResult>& results, const std::function<void(int, unsigned)>& runLocal) {
+        results.assign(seeds.size(), SAResult());
+        best = "BEST " + formatOrdering(cost, start);
+        std::deque<int64_t> queue;
+        for (size_t i = 0; i < seeds.size(); i++)
+            queue.push_back(i);
+        for (Worker& w : workers)
+            if (w.ready && !sendLine(w.fd, best))
+                drop(w, queue);
 
-void progressBar(int currentStep, int totalSteps, const std::string& status) {
-    static int spinnerIndex = 0;
-    const char spinnerChars[] = { '|', '/', '-', '\\' };
-    const int barLength = 10;
-    
-    double progressFraction = static_cast<double>(currentStep) / totalSteps;
-    int filledLength = static_cast<int>(progressFraction * barLength);
-    
-    std::string bar = "[";
-    for (int i = 0; i < filledLength; ++i) {
-        bar += "█";
+        size_t done = 0;
+        std::vector<pollfd> fds;
+        while (done < seeds.size() && !g_stop.load()) {
+            workers.erase(std::remove_if(workers.begin(), workers.end(),
+                                         [](const Worker& w) { return w.fd < 0; }), workers.end());
+            if (workers.empty()) {
+                std::vector<int64_t> chains(queue.begin(), queue.end());
+                queue.clear();
+                ThreadPool::global().parallelFor(chains.size(), [&](int i) {
+                    runLocal(chains[i], seeds[chains[i]]);
+                });
+                done += chains.size();
+                continue;
+            }
+            for (Worker& w : workers) {
+                if (w.ready && w.chain < 0 && !queue.empty()) {
+                    w.chain = queue.front();
+                    queue.pop_front();
+                    if (!sendLine(w.fd, "CHAIN " + std::to_string(w.chain) + " " + std::to_string(seeds[w.chain])))
+                        drop(w, queue);
+                }
+            }
+
+            fds.clear();
+            for (const Worker& w : workers)
+                fds.push_back(pollfd{w.fd, POLLIN, 0});
+            if (listener >= 0)
+                fds.push_back(pollfd{listener, POLLIN, 0});
+            if (poll(fds.data(), fds.size(), COORDINATOR_POLL_MS) <= 0)
+                continue;
+            size_t count = workers.size();
+            for (size_t i = 0; i < count; i++) {
+                Worker& w = workers[i];
+                if (w.fd < 0 || !fds[i].revents)
+                    continue;
+                bool ok = receive(w.fd, w.buffer, false);
+                std::string line;
+                while (ok && nextLine(w.buffer, line))
+                    ok = handle(w, line, results, done);
+                if (!ok) {
+                    std::cerr << "\nswizzle3: lost worker " << (w.pid > 0 ? "process " + std::to_string(w.pid) : "(remote)")
+                              << (w.chain >= 0 ? ", reassigning its chain\n" : "\n");
+                    drop(w, queue);
+                }
+            }
+            if (listener >= 0 && fds.back().revents) {
+                int fd = accept(listener, nullptr, nullptr);
+                if (fd >= 0)
+                    add(fd, -1);
+            }
+        }
     }
-    for (int i = filledLength; i < barLength; ++i) {
-        bar += "░";
+
+    // Tell all workers to quit, and wait for the local ones.
+    void shutdown() {
+        for (Worker& w : workers) {
+            if (w.fd < 0)
+                continue;
+            sendLine(w.fd, "QUIT");
+            close(w.fd);
+            if (w.pid > 0)
+                waitpid(w.pid, nullptr, 0);
+        }
+        workers.clear();
+        if (listener >= 0)
+            close(listener);
     }
-    bar += "]";
-    
-    char spinner = spinnerChars[spinnerIndex % 4];
-    spinnerIndex++;
-    
-    std::cerr << "\r" << bar << " " << currentStep << "/" << totalSteps << " " << status << " " << spinner;
-    std::cerr.flush();
-}
+};
 
 // -----------------------------------------------------------------------------
 // MAIN: MULTI-ROUND DETERMINISTIC SIMULATED ANNEALING ON SECTION ORDERING
@@ -239,42 +2721,195 @@ void progressBar(int currentStep, int totalSteps, const std::string& status) {
 // they must be placed within the first 65536 bytes; otherwise, the permutation is discarded.
 // Finally, the tool outputs a text file listing each candidate section in the optimized order
 // (in the format "file_name:section_name") for later use in a linker script.
+const char* USAGE =
+    "Usage: swizzle3 [options] <output_include_file> <input1.o> [input2.o] ...\n"
+    "Options:\n"
+    "  --prefix <file>       Data placed before the sections in the compressed stream\n"
+    "  --quick               Run a single optimization round\n"
+    "  --mode=anneal         Rounds of independent simulated annealing tries (default)\n"
+    "  --mode=tempering      Parallel tempering (replica exchange)\n"
+    "  --replicas=N          Number of tempering replicas (default: 10)\n"
+    "  --seed=N              Seed of the random moves (default: 42)\n"
+    "  --temp=T              Initial annealing temperature; the tempering ladder spans\n"
+    "                        T/20 to 2T (default: 1)\n"
+    "  --cache-mb=N          Size of the cache of evaluated orderings (default: 64, 0 disables)\n"
+    "  --level=N             Compression level of the final binary (default: 9)\n"
+    "  --top-k=K             Orderings re-scored at that level per round (default: 2)\n"
+    "  --warm-start=FILE     Start from the order in FILE (eg: the previous output)\n"
+    "  --cache-dir=DIR       Reuse results stored in DIR for identical inputs, and store new ones\n"
+    "  --checkpoint=FILE     Save the optimizer state to FILE after every round/epoch\n"
+    "  --resume              Resume from the checkpoint file, if it matches the inputs\n"
+    "  --split[=N]           Split data sections at their symbols, adding up to N fragments\n"
+    "                        (default: 64); only --link can reorder within a section, the\n"
+    "                        output file keeps the sections whole, at their first fragment\n"
+    "  --link=FILE           Also write the linked stage 2 (.text.stage2 + .text.stage2u) to FILE\n"
+    "  --verify=ELF          Link the order in the output file and compare it with ELF\n"
+    "                        (linked by small.1.ld from the same inputs), then exit\n"
+    "  --threads=N           Number of threads (default: all hardware threads)\n"
+    "  --trace=FILE          Write a telemetry trace of the engines every second to FILE\n"
+    "                        (CSV if FILE ends in .csv, JSON Lines otherwise)\n"
+    "  --stats               Print per-engine throughput and time split at exit\n"
+    "  --workers=N           Run the annealing chains in N local worker processes\n"
+    "  --listen=ADDR         Also accept workers at ADDR (unix:PATH or HOST:PORT;\n"
+    "                        :PORT is loopback only, *:PORT all interfaces;\n"
+    "                        not authenticated)\n"
+    "  --connect=ADDR        Run as worker(s) of the coordinator at ADDR, which must\n"
+    "                        be given the same inputs and options\n"
+    "  --pin=S:N             Place section S at position N of the ordering\n"
+    "  --region=S:START:END  Place section(s) S within offsets [START, END)\n"
+    "  --adjacent=S1,S2      Place section S2 immediately after section S1\n"
+    "Sections are given as file(section), or as a section name matching all files.\n"
+    ".sdata/.sbss sections are always restricted to the first 64 KiB.\n";
+
 int main(int argc, char** argv) {
     if (argc < 3) {
-        std::cerr << "Usage: " << argv[0] << " [--prefix prefix_file] [--quick] <output_include_file> <input1.o> [input2.o] ...\n";
+        std::cerr << USAGE;
         return EXIT_FAILURE;
     }
 
-    // 1. Parse optional prefix parameter.
+    // 1. Parse optional parameters.
     std::vector<uint8_t> prefixBuffer;
     int argIndex = 1;
     bool quickMode = false;
-    bool hasPrefix = false;
-    if (std::string(argv[argIndex]) == "--prefix") {
-        if (argc < 4) {
-            std::cerr << "Error: Missing prefix file after --prefix\n";
-            return EXIT_FAILURE;
+    std::string mode = "anneal";
+    int replicas = 10;
+    unsigned randomSeed = 42;
+    double initial_temp = 1.0;
+    int cacheMegabytes = 64;
+    std::string checkpointFile;
+    std::string warmStartFile;
+    std::string cacheDir;
+    std::string linkFile;
+    std::string verifyElf;
+    int workerCount = 0;
+    std::string traceFile;
+    bool printStats = false;
+    std::string listenAddress;
+    std::string connectAddress;
+    int splitFragments = 0;
+    int level = 9;
+    int topK = 2;
+    bool resume = false;
+    std::vector<std::string> pinRules, regionRules, adjacentRules;
+    while (argIndex < argc && std::string(argv[argIndex]).rfind("--", 0) == 0) {
+        std::string arg = argv[argIndex];
+        if (arg == "--prefix") {
+            if (argIndex + 1 >= argc) {
+                std::cerr << "Error: Missing prefix file after --prefix\n";
+                return EXIT_FAILURE;
+            }
+            std::string prefixFile = argv[argIndex + 1];
+            std::ifstream ifs(prefixFile, std::ios::binary);
+            if (!ifs) {
+                std::cerr << "Failed to open prefix file: " << prefixFile << "\n";
+                return EXIT_FAILURE;
+            }
+            prefixBuffer = std::vector<uint8_t>(std::istreambuf_iterator<char>(ifs),
+                                                std::istreambuf_iterator<char>());
+            ifs.close();
+            argIndex += 2;
+            continue;
         }
-        hasPrefix = true;
-        std::string prefixFile = argv[argIndex + 1];
-        std::ifstream ifs(prefixFile, std::ios::binary);
-        if (!ifs) {
-            std::cerr << "Failed to open prefix file: " << prefixFile << "\n";
+        if (arg == "--quick") {
+            quickMode = true;
+        } else if (arg.rfind("--mode=", 0) == 0) {
+            mode = arg.substr(7);
+            if (mode != "anneal" && mode != "tempering") {
+                std::cerr << "Error: Unknown mode: " << mode << "\n";
+                return EXIT_FAILURE;
+            }
+        } else if (arg.rfind("--pin=", 0) == 0) {
+            pinRules.push_back(arg.substr(6));
+        } else if (arg.rfind("--region=", 0) == 0) {
+            regionRules.push_back(arg.substr(9));
+        } else if (arg.rfind("--adjacent=", 0) == 0) {
+            adjacentRules.push_back(arg.substr(11));
+        } else if (arg.rfind("--warm-start=", 0) == 0) {
+            warmStartFile = arg.substr(13);
+        } else if (arg.rfind("--level=", 0) == 0) {
+            level = std::atoi(arg.c_str() + 8);
+            if (level < 0 || level > 9) {
+                std::cerr << "Error: Invalid compression level: " << arg << "\n";
+                return EXIT_FAILURE;
+            }
+        } else if (arg.rfind("--top-k=", 0) == 0) {
+            topK = std::atoi(arg.c_str() + 8);
+            if (topK < 1) {
+                std::cerr << "Error: Invalid number of orderings to confirm: " << arg << "\n";
+                return EXIT_FAILURE;
+            }
+        } else if (arg.rfind("--cache-dir=", 0) == 0) {
+            cacheDir = arg.substr(12);
+        } else if (arg == "--split") {
+            splitFragments = DEFAULT_MAX_FRAGMENTS;
+        } else if (arg.rfind("--split=", 0) == 0) {
+            splitFragments = std::atoi(arg.c_str() + 8);
+        } else if (arg.rfind("--link=", 0) == 0) {
+            linkFile = arg.substr(7);
+        } else if (arg.rfind("--verify=", 0) == 0) {
+            verifyElf = arg.substr(9);
+        } else if (arg.rfind("--checkpoint=", 0) == 0) {
+            checkpointFile = arg.substr(13);
+        } else if (arg == "--resume") {
+            resume = true;
+        } else if (arg.rfind("--cache-mb=", 0) == 0) {
+            cacheMegabytes = std::atoi(arg.c_str() + 11);
+            if (cacheMegabytes < 0) {
+                std::cerr << "Error: Invalid cache size: " << arg << "\n";
+                return EXIT_FAILURE;
+            }
+        } else if (arg.rfind("--replicas=", 0) == 0) {
+            replicas = std::atoi(arg.c_str() + 11);
+            if (replicas < 1) {
+                std::cerr << "Error: Invalid number of replicas: " << arg << "\n";
+                return EXIT_FAILURE;
+            }
+        } else if (arg.rfind("--seed=", 0) == 0) {
+            randomSeed = std::strtoul(arg.c_str() + 7, nullptr, 10);
+        } else if (arg.rfind("--temp=", 0) == 0) {
+            initial_temp = std::atof(arg.c_str() + 7);
+            if (!(initial_temp > 0)) {
+                std::cerr << "Error: Invalid temperature: " << arg << "\n";
+                return EXIT_FAILURE;
+            }
+        } else if (arg.rfind("--workers=", 0) == 0) {
+            workerCount = std::atoi(arg.c_str() + 10);
+            if (workerCount < 0) {
+                std::cerr << "Error: Invalid number of workers: " << arg << "\n";
+                return EXIT_FAILURE;
+            }
+        } else if (arg.rfind("--trace=", 0) == 0) {
+            traceFile = arg.substr(8);
+        } else if (arg == "--stats") {
+            printStats = true;
+        } else if (arg.rfind("--threads=", 0) == 0) {
+            int threads = std::atoi(arg.c_str() + 10);
+            if (threads < 1) {
+                std::cerr << "Error: Invalid number of threads: " << arg << "\n";
+                return EXIT_FAILURE;
+            }
+            ThreadPool::setGlobalSize(threads);
+        } else if (arg.rfind("--listen=", 0) == 0) {
+            listenAddress = arg.substr(9);
+        } else if (arg.rfind("--connect=", 0) == 0) {
+            connectAddress = arg.substr(10);
+        } else {
+            std::cerr << "Error: Unknown option: " << arg << "\n";
             return EXIT_FAILURE;
         }
-        prefixBuffer = std::vector<uint8_t>(std::istreambuf_iterator<char>(ifs),
-                                            std::istreambuf_iterator<char>());
-        ifs.close();
-        argIndex += 2;
-    }
-
-    if (std::string(argv[argIndex]) == "--quick") {
-        quickMode = true;
         argIndex++;
     }
 
     if (argc - argIndex < 2) {
-        std::cerr << "Usage: " << argv[0] << " [--prefix prefix_file] <output_include_file> <input1.o> [input2.o] ...\n";
+        std::cerr << USAGE;
+        return EXIT_FAILURE;
+    }
+    if (resume && checkpointFile.empty()) {
+        std::cerr << "Error: --resume requires --checkpoint\n";
+        return EXIT_FAILURE;
+    }
+    if ((workerCount > 0 || !listenAddress.empty() || !connectAddress.empty()) && mode != "anneal") {
+        std::cerr << "Error: worker processes require --mode=anneal\n";
         return EXIT_FAILURE;
     }
     std::string outputInclude = argv[argIndex++];
@@ -288,12 +2923,36 @@ int main(int argc, char** argv) {
     // 3. Extract Candidate Sections from all Input ELF Object Files.
     // -------------------------------------------------------------------------
     std::vector<SectionCandidate> candidates;
+    StageLayout layout;
+    std::unordered_map<std::string, GlobalSymbol> globals;
+    int unsupportedRelocs = 0;
     for (const auto& file : inputFiles) {
         ELFIO::elfio reader;
         if (!reader.load(file)) {
             std::cerr << "Failed to load file " << file << "\n";
             continue;
         }
+        // Collect the global symbols, to resolve the relocations across files,
+        // and the offsets of the symbols of each section, to split them.
+        std::vector<std::vector<uint32_t>> symbolOffsets(reader.sections.size());
+        for (const auto& sec : reader.sections) {
+            if (sec->get_type() != ELFIO::SHT_SYMTAB)
+                continue;
+            ELFIO::const_symbol_section_accessor symbols(reader, sec.get());
+            for (ELFIO::Elf_Xword j = 0; j < symbols.get_symbols_num(); j++) {
+                std::string name;
+                ELFIO::Elf64_Addr value;
+                ELFIO::Elf_Xword size;
+                unsigned char bind, type, other;
+                ELFIO::Elf_Half section;
+                symbols.get_symbol(j, name, value, size, bind, type, section, other);
+                if (bind != ELFIO::STB_LOCAL && section != ELFIO::SHN_UNDEF &&
+                    section != ELFIO::SHN_ABS && section != ELFIO::SHN_COMMON)
+                    globals.emplace(name, GlobalSymbol{file, section, value});
+                if (section < symbolOffsets.size() && type != ELFIO::STT_SECTION && type != ELFIO::STT_FILE)
+                    symbolOffsets[section].push_back(value);
+            }
+        }
         for (unsigned i = 0; i < reader.sections.size(); i++) {
             ELFIO::section* sec = reader.sections[i];
             std::string sec_name = sec->get_name();
@@ -307,6 +2966,10 @@ int main(int argc, char** argv) {
             // Accept sections of type SHT_PROGBITS or SHT_NOBITS.
             if (sec->get_type() != ELFIO::SHT_PROGBITS && sec->get_type() != ELFIO::SHT_NOBITS)
                 continue;
+            // Sections discarded by small.1.ld.
+            if (sec_name == ".header" || sec_name == ".stage0" || sec_name == ".reginfo" ||
+                sec_name == ".MIPS.abiflags" || sec_name.find(".mdebug.") == 0 || sec_name.find(".gnu.") == 0)
+                continue;
 
             SectionCandidate cand;
             cand.file_name = file;
@@ -315,20 +2978,41 @@ int main(int argc, char** argv) {
             if (cand.alignment == 0)
                 cand.alignment = 1;
             cand.size = static_cast<uint32_t>(sec->get_size());
-            // For SHT_PROGBITS, read raw data; for SHT_NOBITS, generate a zero-filled buffer.
-            if (sec->get_type() == ELFIO::SHT_PROGBITS) {
+            // For SHT_PROGBITS, read raw data; SHT_NOBITS sections are all zeros
+            // and are only represented by their folded image.
+            cand.nobits = sec->get_type() == ELFIO::SHT_NOBITS;
+            if (!cand.nobits) {
                 const char* data = sec->get_data();
                 cand.data.assign(data, data + sec->get_size());
-            } else if (sec->get_type() == ELFIO::SHT_NOBITS) {
-                cand.data.assign(sec->get_size(), 0);
             }
-            // If the section name begins with ".sdata" or ".sbss", mark them as gp-relative.
+            cand.section_index = i;
+            cand.big_endian = reader.get_encoding() == ELFIO::ELFDATA2MSB;
+            // Only data can be split: code has PC-relative branches that are
+            // not relocated, and mergeable sections are rewritten by the linker.
+            cand.splittable = !(sec->get_flags() & (ELFIO::SHF_EXECINSTR | ELFIO::SHF_MERGE));
+            std::vector<uint32_t>& offsets = symbolOffsets[i];
+            std::sort(offsets.begin(), offsets.end());
+            offsets.erase(std::unique(offsets.begin(), offsets.end()), offsets.end());
+            for (uint32_t offset : offsets)
+                if (offset > 0 && offset < cand.size)
+                    cand.symbol_offsets.push_back(offset);
+            unsupportedRelocs += readRelocations(reader, cand);
+            foldZeroRuns(cand);
+            // If the section name begins with ".sdata" or ".sbss", mark them as gp-relative:
+            // they must be entirely within the first GP_RELATIVE_MAX_OFFSET bytes.
             if (sec_name.find(".sdata") == 0 || sec_name.find(".sbss") == 0) {
                 cand.gp_relative = true;
+                cand.region_end = GP_RELATIVE_MAX_OFFSET;
             } else {
                 cand.gp_relative = false;
             }
-            candidates.push_back(cand);
+            // Stage 1 and uncached sections have a fixed placement.
+            if (sec_name == ".stage1")
+                layout.stage1.push_back(cand);
+            else if (sec_name == ".uncached")
+                layout.uncached.push_back(cand);
+            else
+                candidates.push_back(cand);
         }
     }
     if (candidates.empty()) {
@@ -352,10 +3036,131 @@ int main(int argc, char** argv) {
                 return false;
             return a.size < b.size;  // Sort by size for equal types.
         });
+
+    // Resolve the relocations now that the candidate indices are final, then
+    // drop the sections that the link will garbage collect.
+    int undefinedRelocs = resolveRelocations(candidates, layout, globals);
+    if (unsupportedRelocs)
+        std::cerr << "swizzle3: warning: " << unsupportedRelocs << " relocations of unsupported types not applied\n";
+    if (undefinedRelocs)
+        std::cerr << "swizzle3: warning: " << undefinedRelocs << " relocations against undefined symbols\n";
+    if (int dropped = collectGarbage(candidates, layout, globals))
+        std::cerr << "swizzle3: dropped " << dropped << " sections removed by --gc-sections\n";
+    if (splitFragments > 0) {
+        int added = splitSections(candidates, splitFragments);
+        resolveRelocations(candidates, layout, globals);
+        std::cerr << "swizzle3: split sections into " << added << " more fragments\n";
+    }
+    if (candidates.empty()) {
+        std::cerr << "No candidate sections found in the input files.\n";
+        return EXIT_FAILURE;
+    }
+
+    // Stage 2 is linked right after stage 1. When stage 1 is not among the
+    // inputs, the prefix takes its place.
+    for (const SectionCandidate& sec : layout.stage1)
+        layout.stage1_size = align_up(layout.stage1_size, sec.alignment) + sec.size;
+    if (layout.stage1.empty())
+        layout.stage1_size = prefixBuffer.size();
+    layout.stage1_size = align_up(layout.stage1_size, STAGE_ALIGNMENT);
+    layout.stage2_base = LOAD_ADDRESS + layout.stage1_size;
+
+    // Resolve the placement rules given on the command line.
+    auto resolveRule = [&](const std::string& rule, const std::string& spec, bool single) {
+        std::vector<size_t> matches = matchSections(candidates, spec);
+        // A split section is designated by its first fragment.
+        if (single && matches.size() > 1)
+            matches.erase(std::remove_if(matches.begin(), matches.end(), [&](size_t idx) {
+                return candidates[idx].fragment_offset != 0;
+            }), matches.end());
+        if (matches.empty() || (single && matches.size() > 1)) {
+            std::cerr << "Error: " << rule << ": " << (matches.empty() ? "no" : "more than one")
+                      << " section matching " << spec << "\n";
+            exit(EXIT_FAILURE);
+        }
+        return matches;
+    };
+    std::string rule;
+    try {
+        for (const std::string& pinRule : pinRules) {
+            rule = pinRule;
+            size_t colon = rule.rfind(':');
+            if (colon == std::string::npos)
+                throw std::invalid_argument(rule);
+            size_t idx = resolveRule(rule, rule.substr(0, colon), true)[0];
+            candidates[idx].pin = std::stoi(rule.substr(colon + 1));
+            if (candidates[idx].pin < 0 || size_t(candidates[idx].pin) >= candidates.size())
+                throw std::invalid_argument(rule);
+        }
+        for (const std::string& regionRule : regionRules) {
+            rule = regionRule;
+            size_t end = rule.rfind(':');
+            size_t start = end == std::string::npos || end == 0 ? std::string::npos : rule.rfind(':', end - 1);
+            if (start == std::string::npos)
+                throw std::invalid_argument(rule);
+            for (size_t idx : resolveRule(rule, rule.substr(0, start), false)) {
+                candidates[idx].region_start = std::max<uint32_t>(candidates[idx].region_start,
+                    std::stoul(rule.substr(start + 1, end - start - 1), nullptr, 0));
+                candidates[idx].region_end = std::min<uint32_t>(candidates[idx].region_end,
+                    std::stoul(rule.substr(end + 1), nullptr, 0));
+            }
+        }
+        for (const std::string& adjacentRule : adjacentRules) {
+            rule = adjacentRule;
+            size_t comma = rule.find(',');
+            if (comma == std::string::npos)
+                throw std::invalid_argument(rule);
+            size_t first = resolveRule(rule, rule.substr(0, comma), true)[0];
+            size_t second = resolveRule(rule, rule.substr(comma + 1), true)[0];
+            candidates[second].follows = first;
+        }
+    } catch (const std::logic_error&) {
+        std::cerr << "Error: Invalid placement rule: " << rule << "\n";
+        return EXIT_FAILURE;
+    }
+
     std::vector<size_t> globalCandidate(candidates.size());
     for (size_t i = 0; i < candidates.size(); i++)
         globalCandidate[i] = i;
-    size_t globalCost = evaluatePermutation(globalCandidate, candidates, prefixBuffer);
+    applyConstraints(candidates, globalCandidate, layout.stage2_base);
+
+    // Verify mode: check the built-in linker against the GNU ld output.
+    if (!verifyElf.empty())
+        return verifyLink(verifyElf, outputInclude, candidates, layout) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    if (!checkConstraints(candidates, globalCandidate, layout.stage2_base)) {
+        std::cerr << "Error: No valid initial ordering satisfies the placement rules: "
+                  << describeViolation(candidates, globalCandidate, layout.stage2_base) << "\n";
+        return EXIT_FAILURE;
+    }
+
+    // Warm start: begin from a previous order, typically the output of the last
+    // build, so that small changes to the inputs converge quickly.
+    bool warmStarted = false;
+    if (!warmStartFile.empty()) {
+        std::vector<size_t> warmCandidate;
+        size_t dropped, added;
+        double warmCost;
+        if (!readOrder(warmStartFile, candidates, warmCandidate, dropped, added, warmCost)) {
+            std::cerr << "swizzle3: cannot read " << warmStartFile << ", starting from the default order\n";
+        } else {
+            if (!applyConstraints(candidates, warmCandidate, layout.stage2_base)) {
+                std::cerr << "swizzle3: order in " << warmStartFile << " violates the placement rules ("
+                          << describeViolation(candidates, warmCandidate, layout.stage2_base)
+                          << "), starting from the default order\n";
+            } else {
+                std::cerr << "swizzle3: warm start from " << warmStartFile << " ("
+                          << candidates.size() - added << " sections kept, "
+                          << added << " added, " << dropped << " removed)\n";
+                globalCandidate = warmCandidate;
+                warmStarted = true;
+            }
+        }
+    }
+    EvalEngine initialEngine;
+    initialEngine.layout = &layout;
+    initialEngine.relocate(candidates, globalCandidate);
+    double globalCost = initialEngine.evaluate(globalCandidate, candidates, prefixBuffer);
     assert(globalCost != MAX_COST);
 
     // -------------------------------------------------------------------------
@@ -364,60 +3169,358 @@ int main(int argc, char** argv) {
     int rounds = quickMode ? 1 : 10; // total rounds
     int tries_per_round = 10;        // different tries per round
     int iterations_per_round = 300;  // iterations per round per thread
-    double initial_temp = 1.0;
     double cooling_rate = 0.996;
 
-    for (int round = 0; round < rounds && !g_stop.load(); round++) {
-        std::string status = "Optimizing... (" + std::to_string(globalCost) + " bytes)";
-        progressBar(round, rounds, status);
-        std::vector<SAResult> roundResults(tries_per_round);
+    // The result only depends on the sections, prefix, rules and parameters, and
+    // identifies both the checkpoints and the results in the cache.
+    int engineCount = mode == "tempering" ? replicas : tries_per_round;
+    std::ostringstream params;
+    params << "mode=" << mode << " rounds=" << rounds << " replicas=" << engineCount
+           << " iterations=" << iterations_per_round << " temp=" << initial_temp << " cooling=" << cooling_rate
+           << " seed=" << randomSeed
+           << " level=" << level << " top_k=" << topK;
+    uint64_t fingerprint = problemFingerprint(candidates, layout, prefixBuffer, params.str());
 
-        thParaLoop(tries_per_round, [&](int thread_id) {
-            // Each thread uses a fixed seed derived from a constant, round, and thread id.
-            unsigned seed = 42 + round * 100 + thread_id;
-            roundResults[thread_id] = runSAFromCandidate(globalCandidate, candidates, prefixBuffer,
-                                                         iterations_per_round,
-                                                         initial_temp, cooling_rate,
-                                                         seed);
-        });
+    // Look up the result in the cache: if these exact inputs were already
+    // optimized, just output the stored order.
+    std::string resultCacheFile;
+    if (!cacheDir.empty() && connectAddress.empty()) {
+        char key[17];
+        snprintf(key, sizeof(key), "%016llx", (unsigned long long)fingerprint);
+        resultCacheFile = cacheDir + "/" + key + ".ld";
+        std::vector<size_t> cachedCandidate;
+        size_t dropped, added;
+        double cachedCost;
+        if (readOrder(resultCacheFile, candidates, cachedCandidate, dropped, added, cachedCost) &&
+            dropped == 0 && added == 0 && cachedCost != MAX_COST &&
+            checkConstraints(candidates, cachedCandidate, layout.stage2_base)) {
+            if (!writeOrder(outputInclude, candidates, cachedCandidate, cachedCost)) {
+                std::cerr << "Failed to write output include file: " << outputInclude << "\n";
+                return EXIT_FAILURE;
+            }
+            if (!linkFile.empty() && !writeLink(linkFile, candidates, layout, cachedCandidate)) {
+                std::cerr << "Failed to write linked binary: " << linkFile << "\n";
+                return EXIT_FAILURE;
+            }
+            std::cerr << "swizzle3: using cached result " << key << " ("
+                      << int(std::ceil(cachedCost)) << " bytes)\n";
+            return EXIT_SUCCESS;
+        }
+    }
+
+    // Pairwise affinity of the sections. Without a warm start, it seeds the
+    // ordering with the path of highest affinity, if that is better than the
+    // default order. Sections with placement restrictions are moved first if
+    // needed, keeping the order of the path.
+    AffinityMatrix affinity = computeAffinity(candidates);
+    if (!warmStarted && connectAddress.empty()) {
+        std::vector<size_t> seedCandidate = affinitySeed(affinity);
+        // With split sections, the order of the whole sections must stay valid.
+        if (applyConstraints(candidates, seedCandidate, layout.stage2_base) &&
+            checkConstraints(candidates, collapseFragments(candidates, seedCandidate), layout.stage2_base)) {
+            initialEngine.relocate(candidates, seedCandidate);
+            double seedCost = initialEngine.evaluate(seedCandidate, candidates, prefixBuffer);
+            std::cerr << "swizzle3: affinity seed: " << int(std::ceil(seedCost)) << " bytes (default order: "
+                      << int(std::ceil(globalCost)) << " bytes)\n";
+            if (seedCost < globalCost) {
+                globalCandidate = seedCandidate;
+                globalCost = seedCost;
+            }
+        }
+    }
+
+    // Size of the flat binary with and without zero folding, for statistics.
+    size_t unfoldedSize = 0, foldedSize = 0;
+    for (size_t idx : globalCandidate) {
+        const SectionCandidate& cand = candidates[idx];
+        size_t padding = align_up(layout.stage2_base + unfoldedSize, cand.alignment) - layout.stage2_base - unfoldedSize;
+        unfoldedSize += padding + cand.size;
+        foldedSize += padding + cand.image.size();
+    }
+
+    // One evaluation engine per try (or per tempering replica), reused across
+    // rounds so that its arenas and compressor checkpoints are allocated only once.
+    std::vector<EvalEngine> engines(engineCount);
+    for (EvalEngine& engine : engines) {
+        engine.layout = &layout;
+        engine.affinity = &affinity;
+    }
+
+    // All engines share a cache of the costs of the orderings already evaluated,
+    // as the annealing chains keep revisiting the same orderings.
+    std::unique_ptr<TranspositionCache> cache;
+    if (cacheMegabytes > 0) {
+        cache = std::make_unique<TranspositionCache>(size_t(cacheMegabytes) << 20);
+        for (EvalEngine& engine : engines)
+            engine.cache = cache.get();
+    }
+
+    // Worker mode: run the chains handed out by the coordinator, with one
+    // connection per worker process.
+    if (!connectAddress.empty()) {
+        auto work = [&]() {
+            int fd = openSocket(connectAddress, false, "swizzle3");
+            return fd < 0 ? EXIT_FAILURE : runWorker(fd, fingerprint, engines[0], candidates, prefixBuffer,
+                                                     iterations_per_round, initial_temp, cooling_rate);
+        };
+        std::vector<pid_t> pids;
+        for (int i = 1; i < workerCount; i++) {
+            pid_t pid = fork();
+            if (pid == 0)
+                _exit(work());
+            if (pid > 0)
+                pids.push_back(pid);
+        }
+        int status = work();
+        for (pid_t pid : pids) {
+            int childStatus;
+            if (waitpid(pid, &childStatus, 0) < 0 || !WIFEXITED(childStatus) || WEXITSTATUS(childStatus) != 0)
+                status = EXIT_FAILURE;
+        }
+        return status;
+    }
 
-        // Merge per-thread results deterministically.
-        SAResult bestRound = roundResults[0];
-        for (int t = 1; t < tries_per_round; t++) {
-            if (roundResults[t].best_cost < bestRound.best_cost ||
-               (roundResults[t].best_cost == bestRound.best_cost &&
-                roundResults[t].best_permutation < bestRound.best_permutation))
-            {
-                bestRound = roundResults[t];
+    // Coordinator mode: fork the local workers and listen for remote ones.
+    // The workers start from the engines as they are now, so this is done
+    // once they are ready.
+    std::unique_ptr<Coordinator> coordinator;
+    if (workerCount > 0 || !listenAddress.empty()) {
+        coordinator = std::make_unique<Coordinator>();
+        coordinator->fingerprint = fingerprint;
+        coordinator->n = candidates.size();
+        coordinator->candidates = &candidates;
+        coordinator->base = layout.stage2_base;
+        if (!listenAddress.empty()) {
+            coordinator->listener = openSocket(listenAddress, true, "swizzle3");
+            if (coordinator->listener < 0)
+                return EXIT_FAILURE;
+        }
+        for (int i = 0; i < workerCount; i++) {
+            pid_t pid;
+            int fd = forkWorker([&](int fd) {
+                return runWorker(fd, fingerprint, engines[0], candidates, prefixBuffer,
+                                 iterations_per_round, initial_temp, cooling_rate);
+            }, pid);
+            if (fd < 0) {
+                std::cerr << "swizzle3: cannot start worker: " << strerror(errno) << "\n";
+                break;
             }
+            coordinator->add(fd, pid);
+        }
+    }
+
+    // Telemetry of the engines of this process.
+    Telemetry telemetry(engines);
+    if (!traceFile.empty() && !telemetry.trace(traceFile)) {
+        std::cerr << "Error: cannot write trace file " << traceFile << "\n";
+        return EXIT_FAILURE;
+    }
+
+    // Resume from the checkpoint if requested. It is only valid for the same
+    // sections, prefix, rules and parameters.
+    TemperingState tempering;
+    if (mode == "tempering")
+        startTempering(tempering, engines, globalCandidate, randomSeed);
+    // The best ordering is always the best confirmed one, and its cost is the
+    // real compressed size at the final level.
+    Confirmer confirmer{level, topK};
+    confirmer.split = splitFragments > 0;
+    confirmer.base = layout.stage2_base;
+    int firstRound = 0;
+    bool resumed = false;
+    if (resume) {
+        std::ifstream ifs(checkpointFile, std::ios::binary);
+        std::string data((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+        SAResult best, whole;
+        if (!ifs) {
+            std::cerr << "swizzle3: no checkpoint found, starting from scratch\n";
+        } else if (!loadCheckpoint(data, fingerprint, candidates.size(), firstRound, best, whole, engines,
+                                   mode == "tempering" ? &tempering : nullptr)) {
+            std::cerr << "swizzle3: checkpoint does not match the inputs, starting from scratch\n";
+        } else {
+            std::cerr << "swizzle3: resuming from " << (mode == "tempering" ? "epoch " : "round ")
+                      << firstRound << " (" << int(std::ceil(best.best_cost)) << " bytes)\n";
+            globalCandidate = best.best_permutation;
+            globalCost = best.best_cost;
+            confirmer.best = best;
+            confirmer.whole = whole;
+            confirmer.costs[permutationHash(best.best_permutation)] = best.best_cost;
+            confirmer.costs[permutationHash(whole.best_permutation)] = whole.best_cost;
+            resumed = true;
         }
-        globalCandidate = bestRound.best_permutation;
-        globalCost = bestRound.best_cost;
+    }
+    if (!resumed) {
+        confirmer.confirm({ SAResult{globalCandidate, globalCost} }, engines, candidates, prefixBuffer);
+        globalCost = confirmer.best.best_cost;
+        if (confirmer.whole.best_permutation.empty()) {
+            std::cerr << "Error: the initial order of the whole sections breaks the placement rules\n";
+            return EXIT_FAILURE;
+        }
+    }
+    telemetry.best = globalCost;
+
+    // Called after every completed round or epoch: save the best order found so
+    // far (so that an interrupted run still leaves a usable order), and the
+    // checkpoint.
+    // The order files hold the whole sections (see collapseFragments()): when
+    // sections are split, that is the best valid order of the whole sections
+    // (Confirmer::whole), not the best order of the fragments.
+    auto saveProgress = [&](int step) {
+        telemetry.best = globalCost;
+        if (!writeOrder(outputInclude, candidates, confirmer.whole.best_permutation, confirmer.whole.best_cost))
+            std::cerr << "\nswizzle3: failed to write " << outputInclude << "\n";
+        if (!checkpointFile.empty()) {
+            std::string data = saveCheckpoint(fingerprint, step, SAResult{globalCandidate, globalCost},
+                                              confirmer.whole, engines,
+                                              mode == "tempering" ? &tempering : nullptr);
+            if (!writeFileAtomic(checkpointFile, data))
+                std::cerr << "\nswizzle3: failed to write checkpoint " << checkpointFile << "\n";
+        }
+    };
+
+    if (mode == "tempering") {
+        // Same total number of moves per replica as a try gets across all rounds.
+        const int sweep = 50;
+        int epochs = std::max(1, rounds * iterations_per_round / sweep);
+        // Confirm the best replicas as often as the annealing confirms its rounds.
+        const int confirmEvery = std::max(1, iterations_per_round / sweep);
+        runParallelTempering(engines, tempering, candidates, prefixBuffer,
+                             epochs, sweep, initial_temp / 20, initial_temp * 2,
+                             [&](const SAResult&) {
+            if (tempering.epoch % confirmEvery != 0 && tempering.epoch != epochs)
+                return;
+            confirmer.confirm(tempering.results, engines, candidates, prefixBuffer);
+            globalCandidate = confirmer.best.best_permutation;
+            globalCost = confirmer.best.best_cost;
+            saveProgress(tempering.epoch);
+        });
+        if (g_stop.load()) {
+            confirmer.confirm(tempering.results, engines, candidates, prefixBuffer);
+            globalCandidate = confirmer.best.best_permutation;
+            globalCost = confirmer.best.best_cost;
+        }
+    }
+
+    for (int round = firstRound; round < rounds && mode == "anneal" && !g_stop.load(); round++) {
+        std::string status = "Optimizing... (" + std::to_string(int(std::ceil(globalCost))) + " bytes)";
+        progressBar(round, rounds, status);
+        std::vector<SAResult> roundResults(tries_per_round);
+
+        // Each try uses a fixed seed derived from --seed, round, and try id.
+        std::vector<unsigned> seeds(tries_per_round);
+        for (int t = 0; t < tries_per_round; t++)
+            seeds[t] = randomSeed + round * 100 + t;
+        auto runTry = [&](int t, unsigned seed) {
+            roundResults[t] = runSAFromCandidate(engines[t],
+                                                 globalCandidate, candidates, prefixBuffer,
+                                                 iterations_per_round,
+                                                 initial_temp, cooling_rate,
+                                                 seed);
+        };
+        if (coordinator) {
+            coordinator->runChains(globalCandidate, globalCost, seeds, roundResults, runTry);
+            // Chains interrupted by CTRL+C have no result.
+            for (SAResult& result : roundResults)
+                if (result.best_permutation.empty())
+                    result = SAResult{globalCandidate, MAX_COST};
+        } else {
+            ThreadPool::global().parallelFor(tries_per_round, [&](int t) { runTry(t, seeds[t]); });
+        }
+
+        // Confirm the best results of the round at the final compression level,
+        // and start the next round from the best confirmed ordering. Results are
+        // sorted by cost and ordering, so this is deterministic.
+        confirmer.confirm(roundResults, engines, candidates, prefixBuffer);
+        globalCandidate = confirmer.best.best_permutation;
+        globalCost = confirmer.best.best_cost;
+        // An interrupted round is not saved in the checkpoint, so that resuming
+        // replays it in full.
+        if (!g_stop.load())
+            saveProgress(round + 1);
     }
 
     std::cerr << "\r                                                                \r";
+    telemetry.best = globalCost;
+    telemetry.stop();
+    uint64_t evaluations = 0, allocations = 0, cacheHits = 0, remoteEvaluations = 0;
+    uint64_t evaluatedBytes = 0, reencodedBytes = 0;
+    if (coordinator) {
+        coordinator->shutdown();
+        remoteEvaluations = coordinator->evaluations;
+        std::cerr << "swizzle3: " << coordinator->joined << " workers, " << coordinator->lost << " lost, "
+                  << coordinator->reassigned << " chains reassigned\n";
+    }
+    for (const EvalEngine& engine : engines) {
+        evaluations += engine.evaluations;
+        allocations += engine.steady_allocations;
+        cacheHits += engine.cache_hits;
+        evaluatedBytes += engine.evaluatedBytes;
+        reencodedBytes += engine.reencodedBytes;
+    }
+    std::cerr << "swizzle3: " << evaluations + remoteEvaluations << " evaluations, "
+              << allocations << " heap allocations in steady state, "
+              << prefixBuffer.size() + foldedSize << " bytes compressed per evaluation ("
+              << prefixBuffer.size() + unfoldedSize << " before zero folding)\n";
+    // Share of the binary after the first section that moved, which the
+    // incremental compressor re-encodes.
+    if (evaluatedBytes)
+        std::cerr << "swizzle3: " << std::fixed << std::setprecision(1) << 100.0 * reencodedBytes / evaluatedBytes
+                  << "% of the bytes re-encoded per evaluation\n" << std::defaultfloat;
+    std::cerr << "swizzle3: " << confirmer.confirmations << " orderings confirmed at level "
+              << level << ", best: " << std::fixed << std::setprecision(2) << globalCost << " bytes\n";
+    std::cerr << std::defaultfloat;
+    // Cache and move statistics only cover the evaluations done in this process.
+    if (cache && evaluations) {
+        std::cerr << "swizzle3: cache: " << cacheHits << " hits ("
+                  << std::fixed << std::setprecision(1)
+                  << (cacheHits ? 100.0 * cacheHits / (cacheHits + evaluations) : 0.0) << "%), "
+                  << cache->size() << "/" << cache->capacity() << " entries, "
+                  << (cache->bytes() >> 20) << " MiB\n";
+        std::cerr << std::defaultfloat;
+    }
+    for (int op = 0; op < MOVE_COUNT && evaluations; op++) {
+        MoveStats total;
+        for (const EvalEngine& engine : engines) {
+            total.tried += engine.moveStats[op].tried;
+            total.invalid += engine.moveStats[op].invalid;
+            total.accepted += engine.moveStats[op].accepted;
+            total.improved += engine.moveStats[op].improved;
+        }
+        auto percent = [&](uint64_t n) { return total.tried ? 100.0 * n / total.tried : 0.0; };
+        std::cerr << "swizzle3: " << std::setw(9) << std::left << MOVE_NAMES[op] << std::right
+                  << std::setw(8) << total.tried << " moves, " << std::fixed << std::setprecision(1)
+                  << std::setw(5) << percent(total.invalid) << "% invalid, "
+                  << std::setw(5) << percent(total.accepted) << "% accepted, "
+                  << std::setw(5) << percent(total.improved) << "% improving\n";
+        std::cerr << std::defaultfloat;
+    }
+    if (printStats)
+        telemetry.summary();
     std::cerr.flush();
 
     // -------------------------------------------------------------------------
     // 6. Output the Optimized Section Order as a Text File.
     // -------------------------------------------------------------------------
-    // Output format: *(file_name(section_name)) for each candidate section.
-    std::ofstream ofs(outputInclude);
-    if (!ofs) {
-        std::cerr << "Failed to open output include file: " << outputInclude << "\n";
+    const std::vector<size_t>& wholeCandidate = confirmer.whole.best_permutation;
+    double wholeCost = confirmer.whole.best_cost;
+    if (wholeCandidate != globalCandidate)
+        std::cerr << "swizzle3: whole sections: " << int(std::ceil(wholeCost)) << " bytes (fragments: "
+                  << int(std::ceil(globalCost)) << " bytes, with --link)\n";
+    if (!writeOrder(outputInclude, candidates, wholeCandidate, wholeCost)) {
+        std::cerr << "Failed to write output include file: " << outputInclude << "\n";
         return EXIT_FAILURE;
     }
-    ofs << "/* Optimized Section Order - Include in Linker Script */\n";
-    for (size_t idx : globalCandidate) {
-        const SectionCandidate& cand = candidates[idx];
-        if (cand.section_name == ".text.demo") {
-            ofs << "__stage2_entrypoint = .;\n";
-            ofs << "KEEP(" << cand.file_name << "(" << cand.section_name << "))" << "\n";
-        } else {
-            ofs << cand.file_name << "(" << cand.section_name << ")" << "\n";
-        }
+    if (!linkFile.empty() && !writeLink(linkFile, candidates, layout, globalCandidate)) {
+        std::cerr << "Failed to write linked binary: " << linkFile << "\n";
+        return EXIT_FAILURE;
+    }
+    // Store the result in the cache, unless the run was interrupted.
+    if (!resultCacheFile.empty() && !g_stop.load()) {
+        std::error_code ec;
+        std::filesystem::create_directories(cacheDir, ec);
+        if (ec || !writeOrder(resultCacheFile, candidates, wholeCandidate, wholeCost))
+            std::cerr << "swizzle3: failed to write " << resultCacheFile << "\n";
     }
-    ofs.close();
 
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,414 @@
+#!/usr/bin/env python3
+"""
+swizzle3 benchmark
+
+Runs swizzle3 on a set of corpora (the real objects of the build, and
+synthetic corpora of MIPS-like sections), once per thread count, and reports
+for each run the throughput (evaluations per second), the time to reach a
+target size and the final size. Results are written as JSON, and can be
+compared with a previous result file to catch regressions.
+
+Synthetic corpora are generated deterministically (from --seed) as big-endian
+MIPS relocatable objects: functions made of a small vocabulary of instructions
+calling each other (R_MIPS_26) and addressing data (R_MIPS_HI16/LO16), plus
+read-only tables, data, small data and bss sections of varying sizes and
+alignments.
+
+The target size of a corpus is the largest of the best screening costs
+reached by its runs, so that it is reached by all of them: the time to
+target compares how fast each thread count gets there.
+
+Usage:
+    swizzle_bench.py [--swizzle build/swizzle3] [--real a.o b.o ...]
+                     [--sections 50,200] [--threads 1,2,4] [--seed N]
+                     [--full] [--output FILE] [--baseline FILE]
+                     [--tolerance F] [--size-tolerance F]
+"""
+
+import argparse
+import csv
+import json
+import os
+import platform
+import random
+import re
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+# -----------------------------------------------------------------------------
+# Synthetic corpus generator
+# -----------------------------------------------------------------------------
+
+R_MIPS_26 = 4
+R_MIPS_HI16 = 5
+R_MIPS_LO16 = 6
+
+SHT_PROGBITS = 1
+SHT_SYMTAB = 2
+SHT_STRTAB = 3
+SHT_NOBITS = 8
+SHT_REL = 9
+
+SHF_WRITE = 0x1
+SHF_ALLOC = 0x2
+SHF_EXECINSTR = 0x4
+SHF_INFO_LINK = 0x40
+
+STT_OBJECT = 1
+STT_FUNC = 2
+STT_SECTION = 3
+STB_LOCAL = 0
+STB_GLOBAL = 1
+
+# Registers used by the generated code, to get the redundancy of compiled code.
+REGS = [2, 3, 4, 5, 6, 7, 8, 9, 16, 17, 18]
+SP, RA = 29, 31
+
+
+class Section:
+    def __init__(self, name, kind, align, size):
+        self.name = name
+        self.kind = kind            # 'text', 'rodata', 'data', 'sdata', 'bss', 'sbss'
+        self.align = align
+        self.size = size
+        self.data = bytearray()
+        self.relocs = []            # (offset, target section, type)
+
+
+def gen_function(rng, sec, functions, data):
+    """Fill a text section with a function: prologue, body, epilogue."""
+    words = []
+    frame = rng.choice([16, 24, 32, 40, 48])
+    words.append((9 << 26) | (SP << 21) | (SP << 16) | (-frame & 0xffff))  # addiu sp, sp, -frame
+    words.append((0x2b << 26) | (SP << 21) | (RA << 16) | (frame - 4))     # sw ra, frame-4(sp)
+    target = sec.size // 4 - 4
+    while len(words) < target:
+        r = rng.random()
+        rt, rs, rd = rng.choice(REGS), rng.choice(REGS), rng.choice(REGS)
+        if r < 0.12 and functions:
+            sec.relocs.append((len(words) * 4, rng.choice(functions), R_MIPS_26))
+            words.append(3 << 26)                                           # jal func
+            words.append(0)                                                 # nop
+        elif r < 0.22 and data:
+            # lui rt, %hi(sym+off); lw rt, %lo(sym+off)(rt)
+            dst = rng.choice(data)
+            off = rng.randrange(0, max(dst.size, 4), 4)
+            sec.relocs.append((len(words) * 4, dst, R_MIPS_HI16))
+            words.append((0xf << 26) | (rt << 16) | (((off + 0x8000) >> 16) & 0xffff))
+            sec.relocs.append((len(words) * 4, dst, R_MIPS_LO16))
+            words.append((0x23 << 26) | (rt << 21) | (rt << 16) | (off & 0xffff))
+        elif r < 0.45:
+            op = rng.choice([0x23, 0x2b, 0x31])                             # lw, sw, lwc1
+            words.append((op << 26) | (SP << 21) | (rt << 16) | rng.randrange(0, frame - 4, 4))
+        elif r < 0.65:
+            words.append((9 << 26) | (rs << 21) | (rt << 16) | rng.choice([1, 2, 4, 8, 0xffff, 16]))
+        elif r < 0.85:
+            funct = rng.choice([0x21, 0x23, 0x24, 0x25, 0x2a])              # addu, subu, and, or, slt
+            words.append((rs << 21) | (rt << 16) | (rd << 11) | funct)
+        elif r < 0.95:
+            fd, fs, ft = rng.randrange(0, 32, 2), rng.randrange(0, 32, 2), rng.randrange(0, 32, 2)
+            funct = rng.choice([0, 1, 2])                                   # add.s, sub.s, mul.s
+            words.append((0x11 << 26) | (0x10 << 21) | (ft << 16) | (fs << 11) | (fd << 6) | funct)
+        else:
+            words.append((5 << 26) | (rs << 21) | (rt << 16) | (-rng.randrange(2, 16) & 0xffff))  # bne
+            words.append(0)
+    words.append((0x23 << 26) | (SP << 21) | (RA << 16) | (frame - 4))     # lw ra, frame-4(sp)
+    words.append(0x03e00008)                                                # jr ra
+    words.append((9 << 26) | (SP << 21) | (SP << 16) | frame)               # addiu sp, sp, frame
+    words.append(0)
+    sec.data = bytearray(struct.pack('>%dI' % len(words), *words))
+    sec.size = len(sec.data)
+
+
+def gen_data(rng, sec):
+    """Fill a data section with a table of structured values."""
+    kind = rng.choice(['words', 'halves', 'floats', 'bytes'])
+    out = bytearray()
+    base = rng.randrange(0, 1 << 16)
+    while len(out) < sec.size:
+        if kind == 'words':
+            out += struct.pack('>I', (base + rng.randrange(0, 64)) & 0xffffffff)
+        elif kind == 'halves':
+            out += struct.pack('>h', rng.randrange(-512, 512))
+        elif kind == 'floats':
+            out += struct.pack('>f', round(rng.uniform(-4, 4), 2))
+        else:
+            out.append(rng.choice(b'\x00\x01\x02\x03\x10\x20\x40\x80\xff'))
+    sec.data = out[:sec.size]
+
+
+def gen_corpus(rng, count, files):
+    """Return a list of files, each a list of sections, with count sections overall."""
+    kinds = ['text'] * 5 + ['rodata'] * 2 + ['data', 'sdata', 'bss', 'sbss']
+    sections = []
+    for i in range(count):
+        kind = rng.choice(kinds)
+        if kind == 'text':
+            sec = Section('.text.f%d' % i, kind, rng.choice([4, 4, 8, 16]), 4 * int(rng.lognormvariate(4, 0.8)) + 16)
+        elif kind in ('sdata', 'sbss'):
+            sec = Section('.%s.d%d' % (kind, i), kind, rng.choice([1, 2, 4, 8]), rng.choice([1, 2, 4, 8, 12, 16]))
+        else:
+            sec = Section('.%s.d%d' % (kind, i), kind, rng.choice([1, 2, 4, 8, 16]), int(rng.lognormvariate(5, 1.2)) + 4)
+        sections.append(sec)
+    functions = [s for s in sections if s.kind == 'text']
+    data = [s for s in sections if s.kind != 'text']
+    for sec in sections:
+        if sec.kind == 'text':
+            gen_function(rng, sec, functions, data)
+        elif sec.kind not in ('bss', 'sbss'):
+            gen_data(rng, sec)
+    return [sections[k::files] for k in range(files)]
+
+
+def write_elf(path, sections):
+    """Write a big-endian MIPS relocatable ELF with the given sections.
+    Relocations against sections of other files go through global symbols."""
+    names = bytearray(b'\0')
+    strtab = bytearray(b'\0')
+
+    def add_name(table, name):
+        offset = len(table)
+        table += name.encode() + b'\0'
+        return offset
+
+    # Section headers: null, content sections (each followed by its .rel),
+    # .symtab, .strtab, .shstrtab.
+    headers = [None]
+    index = {}
+    for sec in sections:
+        index[sec] = len(headers)
+        headers.append(sec)
+        if sec.relocs:
+            headers.append(('rel', sec))
+    symtab_index = len(headers)
+    strtab_index = symtab_index + 1
+    shstrtab_index = symtab_index + 2
+
+    # Symbols: null, section symbols (local), then the global symbol of each
+    # section and the undefined symbols of the other files.
+    symbols = [(0, 0, 0, 0, 0)]                  # (name, value, size, info, shndx)
+    symbol_of = {}
+    for sec in sections:
+        symbol_of[('section', sec)] = len(symbols)
+        symbols.append((0, 0, 0, (STB_LOCAL << 4) | STT_SECTION, index[sec]))
+    first_global = len(symbols)
+    for sec in sections:
+        symbol_of[('global', sec)] = len(symbols)
+        stype = STT_FUNC if sec.kind == 'text' else STT_OBJECT
+        symbols.append((add_name(strtab, sec.name.split('.')[-1]), 0, sec.size, (STB_GLOBAL << 4) | stype, index[sec]))
+    for sec in sections:
+        for _, target, _ in sec.relocs:
+            if target not in index and ('global', target) not in symbol_of:
+                symbol_of[('global', target)] = len(symbols)
+                symbols.append((add_name(strtab, target.name.split('.')[-1]), 0, 0, (STB_GLOBAL << 4), 0))
+
+    blobs = []
+    for h in headers[1:]:
+        if isinstance(h, tuple):
+            sec = h[1]
+            rel = bytearray()
+            for offset, target, rtype in sec.relocs:
+                sym = symbol_of[('section', target)] if target in index else symbol_of[('global', target)]
+                rel += struct.pack('>II', offset, (sym << 8) | rtype)
+            blobs.append(bytes(rel))
+        else:
+            blobs.append(bytes(h.data) if h.kind not in ('bss', 'sbss') else b'')
+    blobs.append(b''.join(struct.pack('>IIIBBH', n, v, s, i, 0, x) for n, v, s, i, x in symbols))
+    blobs.append(bytes(strtab))
+
+    sh_names = [0]
+    for h in headers[1:]:
+        name = '.rel' + h[1].name if isinstance(h, tuple) else h.name
+        sh_names.append(add_name(names, name))
+    for name in ('.symtab', '.strtab', '.shstrtab'):
+        sh_names.append(add_name(names, name))
+    blobs.append(bytes(names))
+
+    out = bytearray(52)
+    offsets = []
+    for blob in blobs:
+        while len(out) % 16:
+            out.append(0)
+        offsets.append(len(out))
+        out += blob
+    while len(out) % 4:
+        out.append(0)
+    shoff = len(out)
+    out += b'\0' * 40
+    for k, h in enumerate(headers[1:] + ['symtab', 'strtab', 'shstrtab']):
+        blob = blobs[k]
+        if isinstance(h, tuple):
+            hdr = (SHT_REL, SHF_INFO_LINK, 0, offsets[k], len(blob), symtab_index, index[h[1]], 4, 8)
+        elif h == 'symtab':
+            hdr = (SHT_SYMTAB, 0, 0, offsets[k], len(blob), strtab_index, first_global, 4, 16)
+        elif h in ('strtab', 'shstrtab'):
+            hdr = (SHT_STRTAB, 0, 0, offsets[k], len(blob), 0, 0, 1, 0)
+        else:
+            flags = SHF_ALLOC | (SHF_EXECINSTR if h.kind == 'text' else 0)
+            flags |= SHF_WRITE if h.kind in ('data', 'sdata', 'bss', 'sbss') else 0
+            stype = SHT_NOBITS if h.kind in ('bss', 'sbss') else SHT_PROGBITS
+            hdr = (stype, flags, 0, offsets[k], h.size, 0, 0, h.align, 0)
+        out += struct.pack('>IIIIIIIIII', sh_names[k + 1], *hdr)
+
+    ident = b'\x7fELF' + bytes([1, 2, 1]) + b'\0' * 9        # ELFCLASS32, ELFDATA2MSB
+    header = ident + struct.pack('>HHIIIIIHHHHHH', 1, 8, 1, 0, 0, shoff,
+                                 0x20001000,                   # EF_MIPS_ARCH_3 | EF_MIPS_ABI_O32
+                                 52, 0, 0, 40, len(headers) + 3, shstrtab_index)
+    out[0:52] = header
+    with open(path, 'wb') as f:
+        f.write(out)
+
+
+def make_corpus(directory, count, seed, files=4):
+    rng = random.Random(seed * 1000003 + count)
+    groups = gen_corpus(rng, count, files)
+    paths = []
+    for k, group in enumerate(groups):
+        path = os.path.join(directory, 'synth%d_%d.o' % (count, k))
+        write_elf(path, group)
+        paths.append(path)
+    return paths
+
+# -----------------------------------------------------------------------------
+# Benchmark runner
+# -----------------------------------------------------------------------------
+
+
+def run_swizzle(swizzle, objects, threads, full, level, workdir):
+    """Run swizzle3 once, and return the measurements of the run."""
+    trace = os.path.join(workdir, 'trace.csv')
+    order = os.path.join(workdir, 'order.ld')
+    cmd = [swizzle, '--threads=%d' % threads, '--level=%d' % level, '--trace=' + trace]
+    if not full:
+        cmd.append('--quick')
+    cmd += [order] + objects
+    start = time.monotonic()
+    proc = subprocess.run(cmd, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, text=True)
+    wall = time.monotonic() - start
+    if proc.returncode != 0:
+        sys.stderr.write(proc.stderr)
+        raise RuntimeError('swizzle3 failed: ' + ' '.join(cmd))
+    log = proc.stderr.replace('\r', '\n')
+    m = re.search(r'(\d+) evaluations', log)
+    evaluations = int(m.group(1)) if m else 0
+    m = re.search(r'best: ([0-9.]+) bytes', log)
+    final = float(m.group(1)) if m else None
+
+    # Best screening cost over time, from the trace.
+    curve = []
+    with open(trace) as f:
+        for row in csv.DictReader(f):
+            if row['chain_best']:
+                curve.append((float(row['time']), float(row['chain_best'])))
+    best_so_far, points = float('inf'), []
+    for t, cost in sorted(curve):
+        if cost < best_so_far:
+            best_so_far = cost
+            points.append((t, cost))
+    return {
+        'wall_sec': round(wall, 3),
+        'evaluations': evaluations,
+        'evaluations_per_sec': round(evaluations / wall, 2) if wall > 0 else 0,
+        'final_size': final,
+        'screening_best': points[-1][1] if points else None,
+        'curve': points,
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Benchmark swizzle3 throughput and search quality.")
+    parser.add_argument('--swizzle', default='build/swizzle3', help="swizzle3 binary (default: build/swizzle3)")
+    parser.add_argument('--real', nargs='*', default=[], help="Object files of the real corpus")
+    parser.add_argument('--sections', default='50,200', help="Section counts of the synthetic corpora")
+    parser.add_argument('--threads', default=None, help="Thread counts (default: 1 and all cores)")
+    parser.add_argument('--seed', type=int, default=1, help="Seed of the synthetic corpora")
+    parser.add_argument('--level', type=int, default=1, help="Final compression level (default: 1)")
+    parser.add_argument('--full', action='store_true', help="Run all rounds instead of --quick")
+    parser.add_argument('--output', default='build/swizzle-bench.json', help="Result file")
+    parser.add_argument('--baseline', help="Previous result file to compare with")
+    parser.add_argument('--tolerance', type=float, default=0.1,
+                        help="Relative throughput drop reported as a regression (default: 0.1)")
+    parser.add_argument('--size-tolerance', type=float, default=0.005,
+                        help="Relative final size increase reported as a regression (default: 0.005). "
+                             "Multi-threaded annealing is not deterministic, so sizes vary between runs")
+    args = parser.parse_args()
+
+    cores = os.cpu_count() or 1
+    threads = [int(t) for t in args.threads.split(',')] if args.threads else sorted({1, cores})
+    counts = [int(c) for c in args.sections.split(',') if c]
+
+    results = []
+    with tempfile.TemporaryDirectory() as workdir:
+        corpora = []
+        if args.real:
+            missing = [p for p in args.real if not os.path.exists(p)]
+            if missing:
+                print("swizzle_bench: skipping real corpus, missing " + ' '.join(missing), file=sys.stderr)
+            else:
+                corpora.append(('real', args.real))
+        for count in counts:
+            corpora.append(('synthetic-%d' % count, make_corpus(workdir, count, args.seed)))
+
+        for name, objects in corpora:
+            runs = []
+            for t in threads:
+                print("swizzle_bench: %s, %d threads..." % (name, t), file=sys.stderr)
+                run = run_swizzle(args.swizzle, objects, t, args.full, args.level, workdir)
+                run.update(corpus=name, threads=t)
+                runs.append(run)
+            # Target: the worst of the best screening costs, reached by all runs.
+            reached = [r['screening_best'] for r in runs if r['screening_best'] is not None]
+            target = max(reached) if reached else None
+            for run in runs:
+                run['target'] = target
+                run['time_to_target_sec'] = next((t for t, cost in run['curve'] if cost <= target), None) \
+                    if target is not None else None
+                del run['curve']
+                results.append(run)
+
+    report = {
+        'host': platform.node(),
+        'machine': platform.machine(),
+        'cores': cores,
+        'time': time.strftime('%Y-%m-%dT%H:%M:%S'),
+        'full': args.full,
+        'level': args.level,
+        'seed': args.seed,
+        'results': results,
+    }
+    os.makedirs(os.path.dirname(args.output) or '.', exist_ok=True)
+    with open(args.output, 'w') as f:
+        json.dump(report, f, indent=2)
+
+    print("%-16s %7s %9s %10s %11s %11s" % ('corpus', 'threads', 'evals/s', 'final', 'to target', 'wall'))
+    for r in results:
+        ttt = '%.1f s' % r['time_to_target_sec'] if r['time_to_target_sec'] is not None else '-'
+        print("%-16s %7d %9.1f %10.2f %11s %9.1f s" % (r['corpus'], r['threads'], r['evaluations_per_sec'],
+                                                       r['final_size'] or 0, ttt, r['wall_sec']))
+
+    # Compare with the baseline: lower throughput or bigger final sizes.
+    status = 0
+    if args.baseline:
+        with open(args.baseline) as f:
+            baseline = {(r['corpus'], r['threads']): r for r in json.load(f)['results']}
+        for r in results:
+            old = baseline.get((r['corpus'], r['threads']))
+            if not old:
+                continue
+            if r['evaluations_per_sec'] < old['evaluations_per_sec'] * (1 - args.tolerance):
+                print("REGRESSION: %s, %d threads: %.1f evals/s (was %.1f)" % (
+                    r['corpus'], r['threads'], r['evaluations_per_sec'], old['evaluations_per_sec']))
+                status = 1
+            if r['final_size'] and old['final_size'] and \
+                    r['final_size'] > old['final_size'] * (1 + args.size_tolerance):
+                print("REGRESSION: %s, %d threads: final size %.2f (was %.2f)" % (
+                    r['corpus'], r['threads'], r['final_size'], old['final_size']))
+                status = 1
+    return status
+
+
+if __name__ == '__main__':
+    sys.exit(main())
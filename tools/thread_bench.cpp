@@ -0,0 +1,59 @@
+// Microbenchmark of task dispatch latency: spawn-per-call thParaLoop versus
+// the persistent work-stealing ThreadPool.
+//
+// Usage: thread_bench [calls] [tasks_per_call]
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+
+#include "thread_utils.h"
+
+using Clock = std::chrono::steady_clock;
+
+// Run fn() `calls` times, and return the average wall time per call in microseconds.
+template <typename F>
+double measure(int calls, F fn) {
+    fn();  // warm up
+    auto start = Clock::now();
+    for (int i = 0; i < calls; i++)
+        fn();
+    std::chrono::duration<double, std::micro> elapsed = Clock::now() - start;
+    return elapsed.count() / calls;
+}
+
+void report(const std::string& name, double us) {
+    std::cout << std::left << std::setw(40) << name
+              << std::right << std::setw(12) << std::fixed << std::setprecision(2) << us << " us\n";
+}
+
+int main(int argc, char** argv) {
+    int calls = argc > 1 ? std::atoi(argv[1]) : 2000;
+    int tasks = argc > 2 ? std::atoi(argv[2]) : int(std::thread::hardware_concurrency());
+    ThreadPool& pool = ThreadPool::global();
+    std::atomic<uint64_t> sink{0};
+    auto work = [&](int i) { sink += i; };
+
+    std::cout << "threads: " << pool.size() << ", calls: " << calls
+              << ", tasks per call: " << tasks << "\n";
+
+    report("thParaLoop (spawn per call)", measure(calls, [&]() {
+        thParaLoop(tasks, work);
+    }));
+    report("ThreadPool::parallelFor", measure(calls, [&]() {
+        pool.parallelFor(tasks, work);
+    }));
+    report("ThreadPool::submit + wait (1 task)", measure(calls, [&]() {
+        auto future = pool.submit([]() { return 1; });
+        pool.wait(future);
+    }));
+    report("ThreadPool::parallelReduce", measure(calls, [&]() {
+        sink += pool.parallelReduce(tasks, uint64_t(0),
+            [](int i) { return uint64_t(i); },
+            [](uint64_t a, uint64_t b) { return a + b; });
+    }));
+
+    return sink.load() == 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -1,6 +1,16 @@
+#ifndef THREAD_UTILS_H
+#define THREAD_UTILS_H
+
 #include <atomic>
 #include <thread>
 #include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <chrono>
 
 // Calls the function f in parallel using all requested threads, and then
 // wait for all of them to finish.
@@ -15,7 +25,7 @@ inline void thParaLoop(std::function<void()> f, int threads_count=std::thread::h
 
 // paraLoop(h, f) runs a sequence of "h" tasks using multiple tasks. The function
 // will spawn the requested number of work thread, and call f(i) for each value
-// in the range [0, h-1] using all available threads in parallel. 
+// in the range [0, h-1] using all available threads in parallel.
 inline void thParaLoop(int h, std::function<void(int)> f, int threads_count=std::thread::hardware_concurrency()) {
     std::atomic_int gy(0);
     thParaLoop([&](){
@@ -24,3 +34,180 @@ inline void thParaLoop(int h, std::function<void(int)> f, int threads_count=std:
         }
     }, std::min(threads_count, h));
 }
+
+// ThreadPool is a persistent pool of worker threads, to be used instead of
+// thParaLoop when tasks are dispatched often (thParaLoop creates and joins
+// all its threads on every call).
+//
+// Each worker owns a task deque: it pops its own tasks from the back, and when
+// it runs out of work it steals from the front of the other workers' deques.
+// Threads waiting for tasks (parallelFor, wait) keep running queued tasks in
+// the meantime, so it is safe to nest them from within a task.
+class ThreadPool {
+public:
+    explicit ThreadPool(int threads_count=std::thread::hardware_concurrency()) {
+        if (threads_count < 1)
+            threads_count = 1;
+        for (int i=0; i<threads_count; i++)
+            queues.push_back(std::make_unique<Queue>());
+        for (int i=0; i<threads_count; i++)
+            workers.emplace_back([this, i]() { workerLoop(i); });
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            stopping = true;
+        }
+        sleep_cv.notify_all();
+        for (auto& t : workers) t.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Process-wide pool, using all hardware threads unless set otherwise with
+    // setGlobalSize() before its first use.
+    static ThreadPool& global() {
+        static ThreadPool pool(globalSize());
+        return pool;
+    }
+
+    static void setGlobalSize(int threads_count) { globalSize() = threads_count; }
+
+    int size() const { return int(workers.size()); }
+
+    // Queue f() for execution, and return a future for its result.
+    template <typename F>
+    auto submit(F&& f) -> std::future<std::invoke_result_t<std::decay_t<F>>> {
+        using R = std::invoke_result_t<std::decay_t<F>>;
+        auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+        std::future<R> future = task->get_future();
+        push([task]() { (*task)(); });
+        return future;
+    }
+
+    // Wait for a future returned by submit(), running other tasks meanwhile.
+    template <typename T>
+    T wait(std::future<T>& future) {
+        while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            if (!runOne())
+                future.wait_for(std::chrono::microseconds(100));
+        }
+        return future.get();
+    }
+
+    // Call f(i) for each value in the range [0, h-1] using all workers, plus
+    // the calling thread, and wait for all of them to finish.
+    void parallelFor(int h, const std::function<void(int)>& f) {
+        std::atomic_int next(0);
+        auto body = [&]() {
+            for (int i=next++; i<h; i=next++)
+                f(i);
+        };
+        int helpers = std::min(size(), h) - 1;
+        std::atomic_int running(helpers);
+        for (int i=0; i<helpers; i++) {
+            push([&]() {
+                body();
+                running--;
+            });
+        }
+        body();
+        // Helpers still queued must run before returning, as they reference
+        // this stack frame.
+        while (running.load() > 0) {
+            if (!runOne())
+                std::this_thread::yield();
+        }
+    }
+
+    // Compute map(i) for each value in the range [0, h-1] in parallel, then
+    // fold the results into init with reduce(), in index order. The result is
+    // thus independent of the number of threads and of the scheduling.
+    template <typename T, typename Map, typename Reduce>
+    T parallelReduce(int h, T init, Map map, Reduce reduce) {
+        std::vector<T> values(h);
+        parallelFor(h, [&](int i) { values[i] = map(i); });
+        for (auto& v : values)
+            init = reduce(std::move(init), std::move(v));
+        return init;
+    }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic_int pending{0};
+    std::atomic_uint next_queue{0};
+    std::mutex sleep_mutex;
+    std::condition_variable sleep_cv;
+    bool stopping = false;
+
+    static int& globalSize() {
+        static int size = std::thread::hardware_concurrency();
+        return size;
+    }
+
+    // Pool and worker index of the current thread (nullptr/-1 outside workers).
+    static inline thread_local ThreadPool* t_pool = nullptr;
+    static inline thread_local int t_index = -1;
+
+    void push(std::function<void()> task) {
+        // Workers push to their own deque; other threads distribute round-robin.
+        int index = (t_pool == this) ? t_index : int(next_queue++ % queues.size());
+        {
+            std::lock_guard<std::mutex> lock(queues[index]->mutex);
+            queues[index]->tasks.push_back(std::move(task));
+        }
+        pending++;
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+        }
+        sleep_cv.notify_one();
+    }
+
+    // Run a single queued task, if any: first from the back of our own deque,
+    // then stealing from the front of the others.
+    bool runOne() {
+        int self = (t_pool == this) ? t_index : 0;
+        std::function<void()> task;
+        for (size_t k=0; k<queues.size() && !task; k++) {
+            Queue& q = *queues[(self + k) % queues.size()];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            if (q.tasks.empty())
+                continue;
+            if (k == 0 && t_pool == this) {
+                task = std::move(q.tasks.back());
+                q.tasks.pop_back();
+            } else {
+                task = std::move(q.tasks.front());
+                q.tasks.pop_front();
+            }
+        }
+        if (!task)
+            return false;
+        pending--;
+        task();
+        return true;
+    }
+
+    void workerLoop(int index) {
+        t_pool = this;
+        t_index = index;
+        for (;;) {
+            if (runOne())
+                continue;
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            sleep_cv.wait(lock, [this]() { return stopping || pending.load() > 0; });
+            if (stopping && pending.load() == 0)
+                return;
+        }
+    }
+};
+
+#endif
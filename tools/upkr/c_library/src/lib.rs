@@ -1,5 +1,48 @@
 use std::ffi::c_int;
 
+// Count heap allocations per thread, so that callers can check that their
+// steady state doesn't allocate. This replaces the global allocator of the
+// whole program, so it is only built with the allocation-count feature.
+#[cfg(feature = "allocation-count")]
+mod allocation_count {
+    use std::alloc::{GlobalAlloc, Layout, System};
+    use std::cell::Cell;
+
+    struct CountingAllocator;
+
+    thread_local! {
+        pub static ALLOCATIONS: Cell<usize> = const { Cell::new(0) };
+    }
+
+    fn count_allocation() {
+        let _ = ALLOCATIONS.try_with(|count| count.set(count.get() + 1));
+    }
+
+    unsafe impl GlobalAlloc for CountingAllocator {
+        unsafe fn alloc(&self, layout: Layout) -> *mut u8 {
+            count_allocation();
+            System.alloc(layout)
+        }
+
+        unsafe fn alloc_zeroed(&self, layout: Layout) -> *mut u8 {
+            count_allocation();
+            System.alloc_zeroed(layout)
+        }
+
+        unsafe fn realloc(&self, ptr: *mut u8, layout: Layout, new_size: usize) -> *mut u8 {
+            count_allocation();
+            System.realloc(ptr, layout, new_size)
+        }
+
+        unsafe fn dealloc(&self, ptr: *mut u8, layout: Layout) {
+            System.dealloc(ptr, layout)
+        }
+    }
+
+    #[global_allocator]
+    static ALLOCATOR: CountingAllocator = CountingAllocator;
+}
+
 // the upkr config to use, this can be modified to use other configs
 // rasky: configure parity
 fn config() -> upkr::Config {
@@ -27,6 +70,18 @@ pub extern "C" fn upkr_compress(
     packed_data.len()
 }
 
+#[no_mangle]
+pub extern "C" fn upkr_compressed_cost(
+    input_buffer: *const u8,
+    input_size: usize,
+    compression_level: c_int,
+) -> f64 {
+    let input_buffer = unsafe { std::slice::from_raw_parts(input_buffer, input_size) };
+
+    let packed_data = upkr::pack(input_buffer, compression_level.max(0).min(9) as u8, &config(), None);
+    upkr::compressed_size(&packed_data) as f64 * 8.
+}
+
 #[no_mangle]
 pub extern "C" fn upkr_uncompress(output_buffer: *mut u8, output_buffer_size: usize, input_buffer: *const u8, input_size: usize) -> isize {
     let output_buffer = unsafe { std::slice::from_raw_parts_mut(output_buffer, output_buffer_size)};
@@ -43,4 +98,116 @@ pub extern "C" fn upkr_uncompress(output_buffer: *mut u8, output_buffer_size: us
             -1
         }
     }
-}
\ No newline at end of file
+}
+#[no_mangle]
+pub extern "C" fn upkr_allocation_count() -> usize {
+    #[cfg(feature = "allocation-count")]
+    return allocation_count::ALLOCATIONS.with(|count| count.get());
+    #[cfg(not(feature = "allocation-count"))]
+    return 0;
+}
+
+pub struct IncrementalContext(upkr::IncrementalCost);
+
+#[no_mangle]
+pub extern "C" fn upkr_incremental_new() -> *mut IncrementalContext {
+    Box::into_raw(Box::new(IncrementalContext(upkr::IncrementalCost::new(config()))))
+}
+
+#[no_mangle]
+pub extern "C" fn upkr_incremental_free(ctx: *mut IncrementalContext) {
+    if !ctx.is_null() {
+        drop(unsafe { Box::from_raw(ctx) });
+    }
+}
+
+#[no_mangle]
+pub extern "C" fn upkr_incremental_eval(
+    ctx: *mut IncrementalContext,
+    input_buffer: *const u8,
+    input_size: usize,
+    segment_ends: *const usize,
+    segment_count: usize,
+) -> f64 {
+    let ctx = unsafe { &mut *ctx };
+    let input_buffer = unsafe { std::slice::from_raw_parts(input_buffer, input_size) };
+    let segment_ends = unsafe { std::slice::from_raw_parts(segment_ends, segment_count) };
+
+    ctx.0.eval(input_buffer, segment_ends)
+}
+
+#[no_mangle]
+pub extern "C" fn upkr_incremental_eval_from(
+    ctx: *mut IncrementalContext,
+    input_buffer: *const u8,
+    input_size: usize,
+    segment_ends: *const usize,
+    segment_count: usize,
+    unchanged: usize,
+) -> f64 {
+    let ctx = unsafe { &mut *ctx };
+    let input_buffer = unsafe { std::slice::from_raw_parts(input_buffer, input_size) };
+    let segment_ends = unsafe { std::slice::from_raw_parts(segment_ends, segment_count) };
+
+    ctx.0.eval_from(input_buffer, segment_ends, unchanged)
+}
+
+#[no_mangle]
+pub extern "C" fn upkr_incremental_restart_offset(ctx: *const IncrementalContext) -> usize {
+    let ctx = unsafe { &*ctx };
+    ctx.0.restart_offset()
+}
+
+#[no_mangle]
+pub extern "C" fn upkr_incremental_commit(ctx: *mut IncrementalContext) {
+    let ctx = unsafe { &mut *ctx };
+    ctx.0.commit();
+}
+
+pub struct Context(upkr::Packer);
+
+#[no_mangle]
+pub extern "C" fn upkr_context_new() -> *mut Context {
+    Box::into_raw(Box::new(Context(upkr::Packer::new())))
+}
+
+#[no_mangle]
+pub extern "C" fn upkr_context_free(ctx: *mut Context) {
+    if !ctx.is_null() {
+        drop(unsafe { Box::from_raw(ctx) });
+    }
+}
+
+#[no_mangle]
+pub extern "C" fn upkr_context_compress(
+    ctx: *mut Context,
+    output_buffer: *mut u8,
+    output_buffer_size: usize,
+    input_buffer: *const u8,
+    input_size: usize,
+    compression_level: c_int,
+) -> usize {
+    let ctx = unsafe { &mut *ctx };
+    let output_buffer = unsafe { std::slice::from_raw_parts_mut(output_buffer, output_buffer_size) };
+    let input_buffer = unsafe { std::slice::from_raw_parts(input_buffer, input_size) };
+
+    let packed_data = ctx.0.pack(input_buffer, compression_level.max(0).min(9) as u8, &config(), None);
+    let copy_size = packed_data.len().min(output_buffer.len());
+    output_buffer[..copy_size].copy_from_slice(&packed_data[..copy_size]);
+
+    packed_data.len()
+}
+
+#[no_mangle]
+pub extern "C" fn upkr_context_cost(
+    ctx: *mut Context,
+    input_buffer: *const u8,
+    input_size: usize,
+    compression_level: c_int,
+) -> f64 {
+    let ctx = unsafe { &mut *ctx };
+    let input_buffer = unsafe { std::slice::from_raw_parts(input_buffer, input_size) };
+
+    let packed_data = ctx.0.pack(input_buffer, compression_level.max(0).min(9) as u8, &config(), None);
+    upkr::compressed_size(packed_data) as f64 * 8.
+}
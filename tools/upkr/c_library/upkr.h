@@ -19,6 +19,68 @@ size_t upkr_compress(void* output_buffer, size_t output_buffer_size, void* input
 //  < 0  : input data corrupt, unable to decompress
 ptrdiff_t upkr_uncompress(void* output_buffer, size_t output_buffer_size, void* input_buffer, size_t input_size);
 
+// input_buffer/input_size: input data to compress
+// compression_level: 0-9
+// returns the size in (fractional) bits of the compressed data. The data is
+// compressed into an internal buffer, whose final rANS coder state is counted
+// as a fraction of a byte (see upkr::compressed_size, computed in single
+// precision), so this is finer grained than the byte size returned by
+// upkr_compress.
+double upkr_compressed_cost(const void* input_buffer, size_t input_size, int compression_level);
+
+// returns the number of heap allocations made by the library on the calling thread
+// (always 0 unless built with the allocation-count feature, which replaces the
+// global allocator of the Rust code linked into the program)
+size_t upkr_allocation_count(void);
+
+// Incremental cost estimation, for data that is re-evaluated many times with
+// small changes (eg: different orderings of the same sections).
+// The data is split into segments; matches never cross the end of a segment,
+// so the compressor state at each segment end can be checkpointed and reused
+// by later evaluations that share the same leading segments.
+// The estimate follows compression level 1 and is a few percent above the
+// output at higher levels (see IncrementalCost in incremental.rs).
+typedef struct upkr_incremental upkr_incremental;
+
+upkr_incremental* upkr_incremental_new(void);
+void upkr_incremental_free(upkr_incremental* ctx);
+
+// input_buffer/input_size: input data to evaluate
+// segment_ends/segment_count: end offset of each segment (the last must be input_size)
+// returns the estimated size in (fractional) bits of the compressed data. Only the
+// segments starting from the first one that differs from the last committed data
+// are re-encoded.
+double upkr_incremental_eval(upkr_incremental* ctx, const void* input_buffer, size_t input_size, const size_t* segment_ends, size_t segment_count);
+
+// Same as upkr_incremental_eval(), where the first 'unchanged' bytes of the input
+// are known to be the same as in the previous evaluation (committed or not), so
+// that the input is not compared with it. A lower bound is fine.
+double upkr_incremental_eval_from(upkr_incremental* ctx, const void* input_buffer, size_t input_size, const size_t* segment_ends, size_t segment_count, size_t unchanged);
+
+// returns the offset from which the last evaluation re-encoded the input: the
+// bytes before it were skipped thanks to the checkpoints.
+size_t upkr_incremental_restart_offset(const upkr_incremental* ctx);
+
+// Make the data of the last upkr_incremental_eval() the reference for the next ones.
+void upkr_incremental_commit(upkr_incremental* ctx);
+
+// Reusable compression context, for compressing many inputs in a row (eg:
+// different orderings of the same sections). The match finder, parser and
+// output buffers are kept between calls instead of being allocated again,
+// and the match finder is not rebuilt if the input is the same as in the
+// previous call. Results are the same as upkr_compress/upkr_compressed_cost.
+// A context must only be used by one thread at a time.
+typedef struct upkr_context upkr_context;
+
+upkr_context* upkr_context_new(void);
+void upkr_context_free(upkr_context* ctx);
+
+// Same as upkr_compress, using the buffers of the context.
+size_t upkr_context_compress(upkr_context* ctx, void* output_buffer, size_t output_buffer_size, const void* input_buffer, size_t input_size, int compression_level);
+
+// Same as upkr_compressed_cost, using the buffers of the context.
+double upkr_context_cost(upkr_context* ctx, const void* input_buffer, size_t input_size, int compression_level);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,121 @@
+/*
+    Decodes a upkr compressed file with both the reference unpacker (unpack.c) and
+    the fast one (unpack_fast.c), checks that they produce the same output (and
+    the original data, if given), and reports the throughput of each in MB/s of
+    uncompressed data.
+
+    The reference unpacker takes its number of parity contexts at compile time,
+    so this must be built with the same -D UPKR_PARITY as the data was packed
+    with (--parity).
+
+    usage: bench [--iterations=N] compressed_file [original_file]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "unpack_fast.h"
+
+#ifndef UPKR_PARITY
+#define UPKR_PARITY 1
+#endif
+
+#define MAX_SIZE (64*1024*1024)
+
+void* upkr_unpack(void* destination, void* compressed_data);
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static unsigned char* read_file(const char* path, size_t* size) {
+  FILE* file = fopen(path, "rb");
+  if(!file) {
+    fprintf(stderr, "Error: cannot open %s\n", path);
+    return NULL;
+  }
+  unsigned char* data = malloc(MAX_SIZE);
+  *size = fread(data, 1, MAX_SIZE, file);
+  fclose(file);
+  return data;
+}
+
+static volatile ptrdiff_t sink;
+
+// runs the decoder for the given number of iterations, or for at least 0.25s
+// if 0, and returns the throughput in MB/s
+static double bench(int fast, void* out, size_t out_size, void* in, size_t in_size, int iterations) {
+  int count = 0;
+  double start = now(), elapsed;
+  do {
+    if(fast)
+      sink = upkr_unpack_fast(out, out_size, in, in_size, UPKR_PARITY);
+    else
+      sink = (unsigned char*)upkr_unpack(out, in) - (unsigned char*)out;
+    ++count;
+    elapsed = now() - start;
+  } while(iterations ? count < iterations : elapsed < 0.25);
+  return (double)out_size * count / elapsed / 1e6;
+}
+
+int main(int argn, char** argv) {
+  int iterations = 0;
+  const char* files[2] = { NULL, NULL };
+  int num_files = 0;
+  for(int i = 1; i < argn; ++i) {
+    if(strncmp(argv[i], "--iterations=", 13) == 0) {
+      iterations = atoi(argv[i] + 13);
+    } else if(argv[i][0] != '-' && num_files < 2) {
+      files[num_files++] = argv[i];
+    } else {
+      fprintf(stderr, "Error: unexpected argument %s\n", argv[i]);
+      return 2;
+    }
+  }
+  if(num_files == 0) {
+    fprintf(stderr, "usage: %s [--iterations=N] compressed_file [original_file]\n", argv[0]);
+    return 2;
+  }
+
+  size_t in_size, original_size = 0;
+  unsigned char* input = read_file(files[0], &in_size);
+  unsigned char* original = files[1] ? read_file(files[1], &original_size) : NULL;
+  if(!input || (files[1] && !original))
+    return 2;
+
+  // the fast unpacker is bounds checked, so it also finds the size (and the
+  // validity) of the data before the reference one runs on it
+  unsigned char* fast_output = malloc(MAX_SIZE);
+  ptrdiff_t out_size = upkr_unpack_fast(fast_output, MAX_SIZE, input, in_size, UPKR_PARITY);
+  if(out_size < 0) {
+    fprintf(stderr, "Error: %s is not valid upkr data (parity %d)\n", files[0], UPKR_PARITY);
+    return 1;
+  }
+
+  unsigned char* ref_output = malloc(out_size + 1);
+  ptrdiff_t ref_size = (unsigned char*)upkr_unpack(ref_output, input) - ref_output;
+  if(ref_size != out_size || memcmp(ref_output, fast_output, out_size) != 0) {
+    fprintf(stderr, "Error: fast and reference unpackers disagree on %s\n", files[0]);
+    return 1;
+  }
+  if(original && ((size_t)out_size != original_size || memcmp(original, fast_output, out_size) != 0)) {
+    fprintf(stderr, "Error: %s does not unpack to %s\n", files[0], files[1]);
+    return 1;
+  }
+
+  printf("Compressed size: %zu, uncompressed size: %td, parity: %d\n", in_size, out_size, UPKR_PARITY);
+  double ref_speed = bench(0, ref_output, out_size, input, in_size, iterations);
+  double fast_speed = bench(1, fast_output, out_size, input, in_size, iterations);
+  printf("reference: %8.1f MB/s\n", ref_speed);
+  printf("fast:      %8.1f MB/s (%.1fx)\n", fast_speed, fast_speed / ref_speed);
+
+  free(ref_output);
+  free(fast_output);
+  free(original);
+  free(input);
+  return 0;
+}
@@ -0,0 +1,139 @@
+/*
+    Fuzzes the unpackers against the packer of the upkr C library: random inputs
+    (mixes of noise, runs and repeated blocks, so that all kinds of matches occur)
+    are compressed with upkr_compress, and must unpack to the same data with both
+    the reference unpacker (unpack.c) and the fast one (unpack_fast.c). Each
+    compressed buffer is then corrupted and fed to the fast unpacker, which must
+    reject it or unpack it within the bounds of the output buffer.
+
+    upkr_compress packs with the config() of c_library/src/lib.rs, so this must be
+    built with the same -D UPKR_PARITY as its parity_contexts (4).
+
+    usage: fuzz [--iterations=N] [--seed=N]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "upkr.h"
+#include "unpack_fast.h"
+
+#ifndef UPKR_PARITY
+#define UPKR_PARITY 1
+#endif
+
+#define MAX_INPUT (16*1024)
+
+void* upkr_unpack(void* destination, void* compressed_data);
+
+static unsigned long long rng_state;
+
+static unsigned rng(void) {
+  // xorshift64*
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return (unsigned)((rng_state * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static size_t generate(unsigned char* data) {
+  size_t size = rng() % (rng() % 4 == 0 ? 64 : MAX_INPUT);
+  int alphabet = 1 + rng() % 256;
+  size_t pos = 0;
+  while(pos < size) {
+    size_t length = 1 + rng() % (rng() % 8 == 0 ? 1024 : 32);
+    if(length > size - pos)
+      length = size - pos;
+    switch(rng() % 3) {
+    case 0: // noise
+      for(size_t i = 0; i < length; ++i)
+        data[pos + i] = rng() % alphabet;
+      break;
+    case 1: // run
+      memset(data + pos, rng() % alphabet, length);
+      break;
+    case 2: // copy from earlier (possibly overlapping, for short offsets)
+      if(pos > 0) {
+        size_t offset = 1 + rng() % (rng() % 2 ? pos : (pos < 8 ? pos : 8));
+        for(size_t i = 0; i < length; ++i)
+          data[pos + i] = data[pos + i - offset];
+      } else {
+        length = 0;
+      }
+      break;
+    }
+    pos += length;
+  }
+  return size;
+}
+
+int main(int argn, char** argv) {
+  int iterations = 1000;
+  rng_state = 0x9E3779B97F4A7C15ULL;
+  for(int i = 1; i < argn; ++i) {
+    if(strncmp(argv[i], "--iterations=", 13) == 0) {
+      iterations = atoi(argv[i] + 13);
+    } else if(strncmp(argv[i], "--seed=", 7) == 0) {
+      rng_state ^= strtoull(argv[i] + 7, NULL, 0) * 0xBF58476D1CE4E5B9ULL;
+    } else {
+      fprintf(stderr, "Error: unexpected argument %s\n", argv[i]);
+      return 2;
+    }
+  }
+
+  size_t packed_capacity = MAX_INPUT * 2 + 64;
+  unsigned char* input = malloc(MAX_INPUT);
+  unsigned char* packed = malloc(packed_capacity);
+  unsigned char* corrupt = malloc(packed_capacity);
+  unsigned char* output = malloc(MAX_INPUT);
+  unsigned char* ref_output = malloc(MAX_INPUT + 1);
+
+  size_t total_input = 0, total_packed = 0;
+  int rejected = 0;
+  for(int it = 0; it < iterations; ++it) {
+    size_t size = generate(input);
+    int level = rng() % 3;
+    size_t packed_size = upkr_compress(packed, packed_capacity, input, size, level);
+    if(packed_size > packed_capacity) {
+      fprintf(stderr, "Error: iteration %d: compressed data doesn't fit (%zu bytes)\n", it, packed_size);
+      return 1;
+    }
+
+    ptrdiff_t out_size = upkr_unpack_fast(output, size, packed, packed_size, UPKR_PARITY);
+    if(out_size != (ptrdiff_t)size || memcmp(output, input, size) != 0) {
+      fprintf(stderr, "Error: iteration %d: fast unpacker mismatch (%td of %zu bytes, level %d, parity %d)\n", it, out_size, size, level, UPKR_PARITY);
+      return 1;
+    }
+    ptrdiff_t ref_size = (unsigned char*)upkr_unpack(ref_output, packed) - ref_output;
+    if(ref_size != (ptrdiff_t)size || memcmp(ref_output, input, size) != 0) {
+      fprintf(stderr, "Error: iteration %d: reference unpacker mismatch (%td of %zu bytes, level %d)\n", it, ref_size, size, level);
+      return 1;
+    }
+
+    // flip a few bits and/or truncate, the fast unpacker must stay in bounds
+    // (run under -fsanitize=address to check this)
+    memcpy(corrupt, packed, packed_size);
+    size_t corrupt_size = packed_size;
+    int flips = rng() % 4;
+    for(int i = 0; i < flips; ++i)
+      corrupt[rng() % corrupt_size] ^= 1 << (rng() % 8);
+    if(flips == 0 || rng() % 4 == 0)
+      corrupt_size = rng() % corrupt_size;
+    if(upkr_unpack_fast(output, size, corrupt, corrupt_size, UPKR_PARITY) < 0)
+      ++rejected;
+
+    total_input += size;
+    total_packed += packed_size;
+  }
+
+  printf("%d inputs ok (%zu bytes, %zu compressed), %d of %d corrupted inputs rejected\n",
+    iterations, total_input, total_packed, rejected, iterations);
+
+  free(ref_output);
+  free(output);
+  free(corrupt);
+  free(packed);
+  free(input);
+  return 0;
+}
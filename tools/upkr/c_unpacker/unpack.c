@@ -9,6 +9,11 @@
                  on very old CPUs.
     The encoder and decoder need to be configured to use the same varianet.
 
+    The UPKR_PARITY define selects the number of parity contexts (--parity on the
+    encoder, default 1). With parity N, the is match and literal contexts are
+    duplicated N times and selected by the output position modulo N, which helps
+    data made of N-byte words like MIPS code.
+
     upkr compressed data is a rANS byte-/bit-stream encoding a series of literal
     byte values and back-references as probability encoded bits.
 
@@ -55,8 +60,12 @@ typedef unsigned char u8;
 typedef unsigned short u16;
 typedef unsigned long u32;
 
+#ifndef UPKR_PARITY
+#define UPKR_PARITY 1
+#endif
+
 u8* upkr_data_ptr;
-u8 upkr_probs[1 + 255 + 1 + 2*32 + 2*32]; 
+u8 upkr_probs[(1 + 255) * UPKR_PARITY + 1 + 2*32 + 2*32];
 #ifdef UPKR_BITSTREAM
 u16 upkr_state;
 u8 upkr_current_byte;
@@ -126,17 +135,19 @@ void* upkr_unpack(void* destination, void* compressed_data) {
     int prev_was_match = 0;
     int offset = 0;
     for(;;) {
+        // is match and literal contexts of the current output position parity
+        int literal_base = (write_ptr - (u8*)destination) % UPKR_PARITY * 256;
         // is match
-        if(upkr_decode_bit(0)) {
+        if(upkr_decode_bit(literal_base)) {
             // has offset
-            if(prev_was_match || upkr_decode_bit(256)) {
-                offset = upkr_decode_length(257) - 1;
+            if(prev_was_match || upkr_decode_bit(256 * UPKR_PARITY)) {
+                offset = upkr_decode_length(256 * UPKR_PARITY + 1) - 1;
                 if(offset == 0) {
                     // a 0 offset signals the end of the compressed data
                     break;
                 }
             }
-            int length = upkr_decode_length(257 + 64);
+            int length = upkr_decode_length(256 * UPKR_PARITY + 65);
             while(length--) {
                 *write_ptr = write_ptr[-offset];
                 ++write_ptr;
@@ -148,7 +159,7 @@ void* upkr_unpack(void* destination, void* compressed_data) {
             // context index. The set top bit ends up at bit position 8 and is not stored.
             int byte = 1;
             while(byte < 256) {
-                int bit = upkr_decode_bit(byte);
+                int bit = upkr_decode_bit(literal_base + byte);
                 byte = (byte << 1) + bit;
             }
             *write_ptr++ = byte;
@@ -0,0 +1,191 @@
+/*
+    A faster C unpacker for upkr compressed data, for host-side tools.
+
+    This decodes the same format as unpack.c (normal byte-stream variant only), and
+    produces the same output bit for bit, but is meant to validate and benchmark
+    compressed data on the build host rather than to serve as a reference:
+    - the decoder state lives in locals instead of globals, so it stays in registers
+    - the rANS state and probability updates are computed without branching on the
+      decoded bit (which is close to random for literals), and the contexts of
+      both possible next literal bits are loaded before the bit is known
+    - a refill never needs more than one byte (see below), so it is a conditional
+      move instead of a loop
+    - matches are copied with memcpy, doubling the copied chunk for overlapping
+      matches (short offsets) so that long runs are a handful of calls
+    - the number of parity contexts is a parameter, and all reads and writes are
+      bounds checked so it can be run on corrupt data (eg. while fuzzing)
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#include "unpack_fast.h"
+
+typedef unsigned char u8;
+typedef unsigned int u32;
+
+typedef struct {
+    const u8* data;
+    size_t size;
+    // may go past size on corrupt data, as zeros are shifted in past the end
+    size_t pos;
+    u32 state;
+} upkr_fast_decoder;
+
+// decodes a bit with the given probability, and updates the probability
+static inline u32 upkr_fast_decode_prob(upkr_fast_decoder* d, u32* probability) {
+    // After the initial refill the state is >= 4096, and decoding a bit leaves it
+    // >= 16 (probabilities stay within 7..249), so shifting in a single byte is
+    // always enough to bring it back to >= 4096. Past the end of the data zeros
+    // are shifted in; the caller reports the overrun.
+    u32 state = d->state;
+    u32 byte = d->pos < d->size ? d->data[d->pos] : 0;
+    u32 refill = state < 4096;
+    state = refill ? (state << 8) | byte : state;
+    d->pos += refill;
+
+    // bit set:   state = prob * (state >> 8) + low
+    // bit clear: state = (256 - prob) * (state >> 8) + low - prob
+    //                  = state - prob * (state >> 8) - prob
+    // Both share the multiplication, which can then start before the bit is known,
+    // and the result is selected with a mask, as compilers tend to turn a ternary
+    // back into a (mispredicted) branch.
+    u32 prob = *probability;
+    u32 low = state & 255;
+    u32 scaled = prob * (state >> 8);
+    u32 bit = low < prob;
+    u32 mask = 0u - bit;
+    u32 state_set = scaled + low;
+    u32 state_clear = state - scaled - prob;
+    d->state = state_clear ^ ((state_clear ^ state_set) & mask);
+
+    // add 1/16th (rounded) of difference from either 0 or 256
+    u32 prob_set = prob + ((256 - prob + 8) >> 4);
+    u32 prob_clear = prob - ((prob + 8) >> 4);
+    *probability = prob_clear ^ ((prob_clear ^ prob_set) & mask);
+
+    return bit;
+}
+
+static inline u32 upkr_fast_decode_bit(upkr_fast_decoder* d, u8* context) {
+    u32 prob = *context;
+    u32 bit = upkr_fast_decode_prob(d, &prob);
+    *context = (u8)prob;
+    return bit;
+}
+
+// decodes a literal byte, the context of each bit being the bits decoded so far
+static inline u32 upkr_fast_decode_literal(upkr_fast_decoder* d, u8* contexts) {
+    u32 byte = 1;
+    u32 prob = contexts[1];
+    for(int i = 0; i < 7; ++i) {
+        // load the contexts of both possible next bits while this one is decoded,
+        // so that the load is not on the dependency chain
+        u32 zero = contexts[byte * 2];
+        u32 one = contexts[byte * 2 + 1];
+        u32 bit = upkr_fast_decode_prob(d, &prob);
+        contexts[byte] = (u8)prob;
+        byte = (byte << 1) | bit;
+        prob = bit ? one : zero;
+    }
+    u32 bit = upkr_fast_decode_prob(d, &prob);
+    contexts[byte] = (u8)prob;
+    return (byte << 1) | bit;
+}
+
+// returns 0 on success, or -1 if the value doesn't fit in 32 bits
+static inline int upkr_fast_decode_length(upkr_fast_decoder* d, u8* contexts, size_t* value) {
+    size_t length = 0;
+    int bit_pos = 0;
+    while(upkr_fast_decode_bit(d, contexts)) {
+        length |= (size_t)upkr_fast_decode_bit(d, contexts + 1) << bit_pos++;
+        if(bit_pos >= 32)
+            return -1;
+        contexts += 2;
+    }
+    *value = length | ((size_t)1 << bit_pos);
+    return 0;
+}
+
+// copies length bytes from offset bytes back, which may overlap the destination
+static inline u8* upkr_fast_copy_match(u8* write_ptr, size_t offset, size_t length) {
+    // [src, write_ptr) repeats with a period of offset, so it can be appended
+    // as a whole without overlap, doubling the repeating block each time
+    const u8* src = write_ptr - offset;
+    size_t chunk = offset;
+    while(length > chunk) {
+        memcpy(write_ptr, src, chunk);
+        write_ptr += chunk;
+        length -= chunk;
+        chunk <<= 1;
+    }
+    memcpy(write_ptr, src, length);
+    return write_ptr + length;
+}
+
+ptrdiff_t upkr_unpack_fast(void* destination, size_t destination_size, const void* compressed_data, size_t compressed_size, int parity) {
+    u8 contexts[(1 + 255) * UPKR_FAST_MAX_PARITY + 1 + 2*32 + 2*32];
+    if(parity < 1 || parity > UPKR_FAST_MAX_PARITY)
+        return -1;
+
+    // all contexts are initialized to 128 = equal probability of 0 and 1
+    memset(contexts, 128, (1 + 255) * parity + 1 + 2*32 + 2*32);
+    u8* has_offset_context = contexts + 256 * parity;
+    u8* offset_contexts = has_offset_context + 1;
+    u8* length_contexts = offset_contexts + 64;
+
+    upkr_fast_decoder d;
+    d.data = (const u8*)compressed_data;
+    d.size = compressed_size;
+    d.pos = 0;
+    d.state = 0;
+    while(d.state < 4096) {
+        if(d.pos == d.size)
+            return -1;
+        d.state = (d.state << 8) | d.data[d.pos++];
+    }
+
+    u8* write_ptr = (u8*)destination;
+    u8* write_end = write_ptr + destination_size;
+
+    // position of the next byte modulo parity
+    int phase = 0;
+    int prev_was_match = 0;
+    // no offset yet, a repeated offset is out of range
+    size_t offset = SIZE_MAX;
+    for(;;) {
+        u8* literal_contexts = contexts + phase * 256;
+        if(upkr_fast_decode_bit(&d, literal_contexts)) {
+            if(prev_was_match || upkr_fast_decode_bit(&d, has_offset_context)) {
+                if(upkr_fast_decode_length(&d, offset_contexts, &offset))
+                    return -1;
+                offset -= 1;
+                if(offset == 0) {
+                    // a 0 offset signals the end of the compressed data
+                    break;
+                }
+            }
+            size_t length;
+            if(upkr_fast_decode_length(&d, length_contexts, &length))
+                return -1;
+            if(offset > (size_t)(write_ptr - (u8*)destination) || length > (size_t)(write_end - write_ptr))
+                return -1;
+            write_ptr = upkr_fast_copy_match(write_ptr, offset, length);
+            phase = (int)((phase + length) % parity);
+            prev_was_match = 1;
+        } else {
+            u32 byte = upkr_fast_decode_literal(&d, literal_contexts);
+            if(write_ptr == write_end)
+                return -1;
+            *write_ptr++ = (u8)byte;
+            phase = phase + 1 == parity ? 0 : phase + 1;
+            prev_was_match = 0;
+        }
+    }
+
+    // zeros were shifted in past the end of the data
+    if(d.pos > d.size)
+        return -1;
+
+    return write_ptr - (u8*)destination;
+}
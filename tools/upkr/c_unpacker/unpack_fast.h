@@ -0,0 +1,24 @@
+#ifndef UPKR_UNPACK_FAST_H_INCLUDED
+#define UPKR_UNPACK_FAST_H_INCLUDED
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// highest number of parity contexts supported by upkr_unpack_fast
+#define UPKR_FAST_MAX_PARITY 8
+
+// destination/destination_size: buffer to uncompress into
+// compressed_data/compressed_size: compressed data (default byte-stream config)
+// parity: number of parity contexts the data was compressed with (--parity)
+// return value:
+//  >= 0 : size of uncompressed data
+//  < 0  : input data corrupt or destination buffer too small
+ptrdiff_t upkr_unpack_fast(void* destination, size_t destination_size, const void* compressed_data, size_t compressed_size, int parity);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -31,6 +31,11 @@ impl ContextState {
     pub fn context_mut(&mut self, index: usize) -> Context {
         Context { state: self, index }
     }
+
+    /// Overwrite this state with `other` without reallocating.
+    pub fn copy_from(&mut self, other: &ContextState) {
+        self.contexts.copy_from_slice(&other.contexts);
+    }
 }
 
 impl<'a> Context<'a> {
@@ -7,9 +7,13 @@ pub fn pack(
     data: &[u8],
     config: &Config,
     mut progress_callback: Option<ProgressCallback>,
-) -> Vec<u8> {
-    let mut match_finder = MatchFinder::new(data);
-    let mut rans_coder = RansCoder::new(config);
+    match_finder: &mut MatchFinder,
+    rans_coder: &mut RansCoder,
+    output: &mut Vec<u8>,
+) {
+    match_finder.rebuild(data);
+    match_finder.reset_limits();
+    rans_coder.reset(config);
     let mut state = lz::CoderState::new(config);
 
     let mut pos = 0;
@@ -27,7 +31,7 @@ pub fn pack(
                     offset: offset as u32,
                     len: length as u32,
                 }
-                .encode(&mut rans_coder, &mut state, config);
+                .encode(rans_coder, &mut state, config);
                 pos += length;
                 encoded_match = true;
             }
@@ -47,7 +51,7 @@ pub fn pack(
                         offset: offset as u32,
                         len: length as u32,
                     }
-                    .encode(&mut rans_coder, &mut state, config);
+                    .encode(rans_coder, &mut state, config);
                     pos += length;
                     encoded_match = true;
                 }
@@ -55,11 +59,11 @@ pub fn pack(
         }
 
         if !encoded_match {
-            lz::Op::Literal(data[pos]).encode(&mut rans_coder, &mut state, config);
+            lz::Op::Literal(data[pos]).encode(rans_coder, &mut state, config);
             pos += 1;
         }
     }
 
-    lz::encode_eof(&mut rans_coder, &mut state, config);
-    rans_coder.finish()
+    lz::encode_eof(rans_coder, &mut state, config);
+    rans_coder.finish_into(output);
 }
@@ -10,12 +10,14 @@
 mod context_state;
 mod greedy_packer;
 mod heatmap;
+mod incremental;
 mod lz;
 mod match_finder;
 mod parsing_packer;
 mod rans;
 
 pub use heatmap::Heatmap;
+pub use incremental::IncrementalCost;
 pub use lz::{calculate_margin, create_heatmap, unpack, UnpackError};
 
 /// The type of a callback function to be given to the `pack` function.
@@ -127,10 +129,85 @@ pub fn pack(
     config: &Config,
     progress_callback: Option<ProgressCallback>,
 ) -> Vec<u8> {
-    if level == 0 {
-        greedy_packer::pack(data, config, progress_callback)
-    } else {
-        parsing_packer::pack(data, level, config, progress_callback)
+    let mut packer = Packer::new();
+    packer.pack(data, level, config, progress_callback);
+    packer.output
+}
+
+/// A compressor that keeps its buffers between calls.
+///
+/// Compressing many inputs with the same `Packer` (eg: different orderings of
+/// the same data) reuses the suffix and LCP arrays of the match finder, the
+/// parser arrivals and coder states, and the output buffer, instead of
+/// allocating them again for every input. If the data is the same as in the
+/// previous call, the match finder is not rebuilt at all.
+///
+/// The result is the same as with `pack`.
+///
+/// # Example
+/// ```rust
+/// let mut packer = upkr::Packer::new();
+/// let config = upkr::Config::default();
+/// for data in [b"Hello, World! Yellow world!", b"Yellow world! Hello, World!"] {
+///     let size = packer.pack(data, 1, &config, None).len();
+///     assert_eq!(size, upkr::pack(data, 1, &config, None).len());
+/// }
+/// ```
+pub struct Packer {
+    match_finder: match_finder::MatchFinder,
+    workspace: parsing_packer::Workspace,
+    coder: rans::RansCoder,
+    output: Vec<u8>,
+}
+
+impl Packer {
+    /// Creates a new compressor, with no buffers allocated yet.
+    pub fn new() -> Packer {
+        Packer {
+            match_finder: match_finder::MatchFinder::default(),
+            workspace: parsing_packer::Workspace::default(),
+            coder: rans::RansCoder::new(&Config::default()),
+            output: Vec::new(),
+        }
+    }
+
+    /// Compresses the given data, like `pack`. The result is valid until the
+    /// next call.
+    pub fn pack(
+        &mut self,
+        data: &[u8],
+        level: u8,
+        config: &Config,
+        progress_callback: Option<ProgressCallback>,
+    ) -> &[u8] {
+        if level == 0 {
+            greedy_packer::pack(
+                data,
+                config,
+                progress_callback,
+                &mut self.match_finder,
+                &mut self.coder,
+                &mut self.output,
+            );
+        } else {
+            parsing_packer::pack(
+                data,
+                level,
+                config,
+                progress_callback,
+                &mut self.match_finder,
+                &mut self.workspace,
+                &mut self.coder,
+                &mut self.output,
+            );
+        }
+        &self.output
+    }
+}
+
+impl Default for Packer {
+    fn default() -> Packer {
+        Packer::new()
     }
 }
 
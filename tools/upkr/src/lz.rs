@@ -131,6 +131,14 @@ impl CoderState {
     pub fn last_offset(&self) -> u32 {
         self.last_offset
     }
+
+    /// Overwrite this state with `other` without reallocating.
+    pub fn copy_from(&mut self, other: &CoderState) {
+        self.contexts.copy_from(&other.contexts);
+        self.last_offset = other.last_offset;
+        self.prev_was_match = other.prev_was_match;
+        self.pos = other.pos;
+    }
 }
 
 /// The error type for the uncompressing related functions
@@ -2,6 +2,7 @@ use std::collections::BinaryHeap;
 use std::ops::Range;
 
 pub struct MatchFinder {
+    data: Vec<u8>,
     suffixes: Vec<i32>,
     rev_suffixes: Vec<u32>,
     lcp: Vec<u32>,
@@ -14,63 +15,79 @@ pub struct MatchFinder {
     queue: BinaryHeap<usize>
 }
 
+impl Default for MatchFinder {
+    fn default() -> MatchFinder {
+        let mut match_finder = MatchFinder {
+            data: Vec::new(),
+            suffixes: Vec::new(),
+            rev_suffixes: Vec::new(),
+            lcp: Vec::new(),
+            max_queue_size: 0,
+            max_matches_per_length: 0,
+            patience: 0,
+            max_length_diff: 0,
+            queue: BinaryHeap::new(),
+        };
+        match_finder.reset_limits();
+        match_finder
+    }
+}
+
 impl MatchFinder {
-    pub fn new(data: &[u8]) -> MatchFinder {
-        let mut suffixes = vec![0i32; data.len()];
-        cdivsufsort::sort_in_place(data, &mut suffixes);
+    /// Rebuilds the suffix and LCP arrays for `data`, reusing the buffers of
+    /// the previous data. The arrays are kept as they are if `data` is the
+    /// same as the previous data.
+    pub fn rebuild(&mut self, data: &[u8]) {
+        if self.data.as_slice() == data && self.suffixes.len() == data.len() {
+            return;
+        }
+        self.data.clear();
+        self.data.extend_from_slice(data);
+
+        self.suffixes.clear();
+        self.suffixes.resize(data.len(), 0);
+        cdivsufsort::sort_in_place(data, &mut self.suffixes);
 
-        let mut rev_suffixes = vec![0u32; data.len()];
-        for (suffix_index, index) in suffixes.iter().enumerate() {
-            rev_suffixes[*index as usize] = suffix_index as u32;
+        self.rev_suffixes.clear();
+        self.rev_suffixes.resize(data.len(), 0);
+        for (suffix_index, index) in self.suffixes.iter().enumerate() {
+            self.rev_suffixes[*index as usize] = suffix_index as u32;
         }
 
-        let mut lcp = vec![0u32; data.len()];
+        self.lcp.clear();
+        self.lcp.resize(data.len(), 0);
         let mut length = 0usize;
-        for suffix_index in &rev_suffixes {
-            if *suffix_index as usize + 1 < suffixes.len() {
-                let i = suffixes[*suffix_index as usize] as usize;
-                let j = suffixes[*suffix_index as usize + 1] as usize;
+        for suffix_index in &self.rev_suffixes {
+            if *suffix_index as usize + 1 < self.suffixes.len() {
+                let i = self.suffixes[*suffix_index as usize] as usize;
+                let j = self.suffixes[*suffix_index as usize + 1] as usize;
                 while i + length < data.len()
                     && j + length < data.len()
                     && data[i + length] == data[j + length]
                 {
                     length += 1;
                 }
-                lcp[*suffix_index as usize] = length as u32;
+                self.lcp[*suffix_index as usize] = length as u32;
             }
             length = length.saturating_sub(1);
         }
-
-        MatchFinder {
-            suffixes,
-            rev_suffixes,
-            lcp,
-            max_queue_size: 100,
-            max_matches_per_length: 5,
-            patience: 100,
-            max_length_diff: 2,
-            queue: BinaryHeap::new()
-        }
-    }
-
-    pub fn with_max_queue_size(mut self, v: usize) -> MatchFinder {
-        self.max_queue_size = v;
-        self
-    }
-
-    pub fn with_patience(mut self, v: usize) -> MatchFinder {
-        self.patience = v;
-        self
     }
 
-    pub fn with_max_matches_per_length(mut self, v: usize) -> MatchFinder {
-        self.max_matches_per_length = v;
-        self
+    pub fn reset_limits(&mut self) {
+        self.set_limits(100, 100, 5, 2);
     }
 
-    pub fn with_max_length_diff(mut self, v: usize) -> MatchFinder {
-        self.max_length_diff = v;
-        self
+    pub fn set_limits(
+        &mut self,
+        max_queue_size: usize,
+        patience: usize,
+        max_matches_per_length: usize,
+        max_length_diff: usize,
+    ) {
+        self.max_queue_size = max_queue_size;
+        self.patience = patience;
+        self.max_matches_per_length = max_matches_per_length;
+        self.max_length_diff = max_length_diff;
     }
 
     pub fn matches(&mut self, pos: usize) -> Matches {
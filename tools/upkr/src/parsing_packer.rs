@@ -1,6 +1,5 @@
 use std::collections::{HashMap, HashSet};
 use std::mem;
-use std::rc::Rc;
 
 use crate::match_finder::MatchFinder;
 use crate::rans::{CostCounter, RansCoder};
@@ -11,53 +10,157 @@ pub fn pack(
     level: u8,
     config: &crate::Config,
     progress_cb: Option<ProgressCallback>,
-) -> Vec<u8> {
-    let mut parse = parse(data, Config::from_level(level), config, progress_cb);
-    let mut ops = vec![];
-    while let Some(link) = parse {
-        ops.push(link.op);
-        parse = link.prev.clone();
+    match_finder: &mut MatchFinder,
+    workspace: &mut Workspace,
+    coder: &mut RansCoder,
+    output: &mut Vec<u8>,
+) {
+    let last = parse(
+        data,
+        Config::from_level(level),
+        config,
+        progress_cb,
+        match_finder,
+        workspace,
+    );
+    let mut ops = mem::take(&mut workspace.ops);
+    ops.clear();
+    let mut link = last;
+    while link != NO_PARSE {
+        ops.push(workspace.links[link as usize].op);
+        link = workspace.links[link as usize].prev;
     }
+    workspace.release(last);
     let mut state = lz::CoderState::new(config);
-    let mut coder = RansCoder::new(config);
-    for op in ops.into_iter().rev() {
-        op.encode(&mut coder, &mut state, config);
+    coder.reset(config);
+    for op in ops.iter().rev() {
+        op.encode(coder, &mut state, config);
     }
-    lz::encode_eof(&mut coder, &mut state, config);
-    coder.finish()
+    lz::encode_eof(coder, &mut state, config);
+    coder.finish_into(output);
+    workspace.ops = ops;
 }
 
+const NO_PARSE: u32 = u32::MAX;
+
+// A link of a parse, ie. the last op and the index of the link before it.
+// Links are shared by the arrivals that extend the same parse, and are
+// reference counted.
 struct Parse {
-    prev: Option<Rc<Parse>>,
+    prev: u32,
     op: lz::Op,
+    refs: u32,
 }
 
 struct Arrival {
-    parse: Option<Rc<Parse>>,
+    parse: u32,
     state: lz::CoderState,
     cost: f64,
 }
 
-type Arrivals = HashMap<usize, Vec<Arrival>>;
+/// Buffers of the parser, kept across calls to avoid reallocating them.
+///
+/// The parse links and the coder states are allocated for every arrival, so
+/// the links live in an arena and the states of discarded arrivals are recycled.
+#[derive(Default)]
+pub struct Workspace {
+    arrivals: Vec<Vec<Arrival>>,
+    free_states: Vec<lz::CoderState>,
+    links: Vec<Parse>,
+    free_links: Vec<u32>,
+    state_config: Option<(usize, bool, bool)>,
+    best_per_offset: HashMap<u32, f64>,
+    seen_offsets: HashSet<u32>,
+    sorted: Vec<Arrival>,
+    remaining: Vec<Arrival>,
+    ops: Vec<lz::Op>,
+}
+
+impl Workspace {
+    // Drop the recycled states if they were made for a different config.
+    fn set_config(&mut self, config: &crate::Config) {
+        let key = (
+            config.parity_contexts,
+            config.invert_bit_encoding,
+            config.simplified_prob_update,
+        );
+        if self.state_config != Some(key) {
+            self.free_states.clear();
+            self.state_config = Some(key);
+        }
+    }
+
+    // Add a link after `prev`, taking over a reference to it.
+    fn push_link(&mut self, prev: u32, op: lz::Op) -> u32 {
+        let link = Parse { prev, op, refs: 1 };
+        if let Some(index) = self.free_links.pop() {
+            self.links[index as usize] = link;
+            index
+        } else {
+            self.links.push(link);
+            self.links.len() as u32 - 1
+        }
+    }
+
+    fn retain(&mut self, link: u32) {
+        if link != NO_PARSE {
+            self.links[link as usize].refs += 1;
+        }
+    }
+
+    fn release(&mut self, mut link: u32) {
+        while link != NO_PARSE {
+            let parse = &mut self.links[link as usize];
+            parse.refs -= 1;
+            if parse.refs > 0 {
+                break;
+            }
+            self.free_links.push(link);
+            link = parse.prev;
+        }
+    }
+
+    fn discard(&mut self, arrival: Arrival) {
+        self.release(arrival.parse);
+        self.free_states.push(arrival.state);
+    }
+
+    fn clone_state(&mut self, state: &lz::CoderState) -> lz::CoderState {
+        match self.free_states.pop() {
+            Some(mut copy) => {
+                copy.copy_from(state);
+                copy
+            }
+            None => state.clone(),
+        }
+    }
+}
 
 fn parse(
     data: &[u8],
     config: Config,
     encoding_config: &crate::Config,
     mut progress_cb: Option<ProgressCallback>,
-) -> Option<Rc<Parse>> {
-    let mut match_finder = MatchFinder::new(data)
-        .with_max_queue_size(config.max_queue_size)
-        .with_patience(config.patience)
-        .with_max_matches_per_length(config.max_matches_per_length)
-        .with_max_length_diff(config.max_length_diff);
+    match_finder: &mut MatchFinder,
+    workspace: &mut Workspace,
+) -> u32 {
+    match_finder.rebuild(data);
+    match_finder.set_limits(
+        config.max_queue_size,
+        config.patience,
+        config.max_matches_per_length,
+        config.max_length_diff,
+    );
     let mut near_matches = [usize::MAX; 1024];
     let mut last_seen = [usize::MAX; 256];
 
     let max_arrivals = config.max_arrivals;
 
-    let mut arrivals: Arrivals = HashMap::new();
-    fn sort_arrivals(vec: &mut Vec<Arrival>, max_arrivals: usize) {
+    workspace.set_config(encoding_config);
+    let mut arrivals = mem::take(&mut workspace.arrivals);
+    arrivals.resize_with(arrivals.len().max(data.len() + 1), Vec::new);
+
+    fn sort_arrivals(vec: &mut Vec<Arrival>, max_arrivals: usize, workspace: &mut Workspace) {
         if max_arrivals == 0 {
             return;
         }
@@ -66,42 +169,59 @@ fn parse(
                 .partial_cmp(&b.cost)
                 .unwrap_or(std::cmp::Ordering::Equal)
         });
-        let mut seen_offsets = HashSet::new();
-        let mut remaining = Vec::new();
-        for arr in mem::replace(vec, Vec::new()) {
-            if seen_offsets.insert(arr.state.last_offset()) {
+        let mut sorted = mem::take(&mut workspace.sorted);
+        let mut remaining = mem::take(&mut workspace.remaining);
+        mem::swap(vec, &mut sorted);
+        workspace.seen_offsets.clear();
+        for arr in sorted.drain(..) {
+            if workspace.seen_offsets.insert(arr.state.last_offset()) {
                 if vec.len() < max_arrivals {
                     vec.push(arr);
+                } else {
+                    workspace.discard(arr);
                 }
             } else {
                 remaining.push(arr);
             }
         }
-        for arr in remaining {
+        for arr in remaining.drain(..) {
             if vec.len() >= max_arrivals {
-                break;
+                workspace.discard(arr);
+            } else {
+                vec.push(arr);
             }
-            vec.push(arr);
         }
+        workspace.sorted = sorted;
+        workspace.remaining = remaining;
     }
 
-    fn add_arrival(arrivals: &mut Arrivals, pos: usize, arrival: Arrival, max_arrivals: usize) {
-        let vec = arrivals.entry(pos).or_default();
+    fn add_arrival(
+        arrivals: &mut [Vec<Arrival>],
+        workspace: &mut Workspace,
+        pos: usize,
+        arrival: Arrival,
+        max_arrivals: usize,
+    ) {
+        let vec = &mut arrivals[pos];
         if max_arrivals == 0 {
             if vec.is_empty() {
                 vec.push(arrival);
             } else if vec[0].cost > arrival.cost {
-                vec[0] = arrival;
+                let old = mem::replace(&mut vec[0], arrival);
+                workspace.discard(old);
+            } else {
+                workspace.discard(arrival);
             }
             return;
         }
         vec.push(arrival);
         if vec.len() > max_arrivals * 2 {
-            sort_arrivals(vec, max_arrivals);
+            sort_arrivals(vec, max_arrivals, workspace);
         }
     }
     fn add_match(
-        arrivals: &mut Arrivals,
+        arrivals: &mut [Vec<Arrival>],
+        workspace: &mut Workspace,
         cost_counter: &mut CostCounter,
         pos: usize,
         offset: usize,
@@ -115,39 +235,40 @@ fn parse(
         }
         length = length.min(config.max_length);
         cost_counter.reset();
-        let mut state = arrival.state.clone();
+        let mut state = workspace.clone_state(&arrival.state);
         let op = lz::Op::Match {
             offset: offset as u32,
             len: length as u32,
         };
         op.encode(cost_counter, &mut state, config);
+        workspace.retain(arrival.parse);
+        let parse = workspace.push_link(arrival.parse, op);
         add_arrival(
             arrivals,
+            workspace,
             pos + length,
             Arrival {
-                parse: Some(Rc::new(Parse {
-                    prev: arrival.parse.clone(),
-                    op,
-                })),
+                parse,
                 state,
                 cost: arrival.cost + cost_counter.cost(),
             },
             max_arrivals,
         );
     }
+    let initial_state = lz::CoderState::new(encoding_config);
     add_arrival(
         &mut arrivals,
+        workspace,
         0,
         Arrival {
-            parse: None,
-            state: lz::CoderState::new(encoding_config),
+            parse: NO_PARSE,
+            state: initial_state,
             cost: 0.0,
         },
         max_arrivals,
     );
 
     let cost_counter = &mut CostCounter::new(encoding_config);
-    let mut best_per_offset = HashMap::new();
     for pos in 0..data.len() {
         let match_length = |offset: usize| {
             data[pos..]
@@ -157,29 +278,37 @@ fn parse(
                 .count()
         };
 
-        let here_arrivals = if let Some(mut arr) = arrivals.remove(&pos) {
-            sort_arrivals(&mut arr, max_arrivals);
-            arr
-        } else {
+        // Arrivals are only ever added after pos, so the vector can be taken
+        // out while they are processed and put back empty afterwards.
+        let mut here_arrivals = mem::take(&mut arrivals[pos]);
+        if here_arrivals.is_empty() {
+            arrivals[pos] = here_arrivals;
             continue;
-        };
-        best_per_offset.clear();
+        }
+        sort_arrivals(&mut here_arrivals, max_arrivals, workspace);
+        workspace.best_per_offset.clear();
         let mut best_cost = f64::MAX;
         for arrival in &here_arrivals {
             best_cost = best_cost.min(arrival.cost);
-            let per_offset = best_per_offset
+            let per_offset = workspace
+                .best_per_offset
                 .entry(arrival.state.last_offset())
                 .or_insert(f64::MAX);
             *per_offset = per_offset.min(arrival.cost);
         }
 
-        'arrival_loop: for arrival in here_arrivals {
+        let mut here = here_arrivals.drain(..);
+        'arrival_loop: while let Some(arrival) = here.next() {
             if arrival.cost
                 > (best_cost + config.max_cost_delta).min(
-                    *best_per_offset.get(&arrival.state.last_offset()).unwrap()
+                    *workspace
+                        .best_per_offset
+                        .get(&arrival.state.last_offset())
+                        .unwrap()
                         + config.max_offset_cost_delta,
                 )
             {
+                workspace.discard(arrival);
                 continue;
             }
             let mut found_last_offset = false;
@@ -191,6 +320,7 @@ fn parse(
                     found_last_offset |= offset as u32 == arrival.state.last_offset();
                     add_match(
                         &mut arrivals,
+                        workspace,
                         cost_counter,
                         pos,
                         offset,
@@ -200,6 +330,7 @@ fn parse(
                         encoding_config,
                     );
                     if m.length >= config.greedy_size {
+                        workspace.discard(arrival);
                         break 'arrival_loop;
                     }
                 }
@@ -219,6 +350,7 @@ fn parse(
                 assert!(length > 0);
                 add_match(
                     &mut arrivals,
+                    workspace,
                     cost_counter,
                     pos,
                     offset,
@@ -240,6 +372,7 @@ fn parse(
                 if length > 0 {
                     add_match(
                         &mut arrivals,
+                        workspace,
                         cost_counter,
                         pos,
                         offset,
@@ -255,27 +388,36 @@ fn parse(
             let mut state = arrival.state;
             let op = lz::Op::Literal(data[pos]);
             op.encode(cost_counter, &mut state, encoding_config);
+            let parse = workspace.push_link(arrival.parse, op);
             add_arrival(
                 &mut arrivals,
+                workspace,
                 pos + 1,
                 Arrival {
-                    parse: Some(Rc::new(Parse {
-                        prev: arrival.parse,
-                        op,
-                    })),
+                    parse,
                     state,
                     cost: arrival.cost + cost_counter.cost(),
                 },
                 max_arrivals,
             );
         }
+        for arrival in here {
+            workspace.discard(arrival);
+        }
+        arrivals[pos] = here_arrivals;
         near_matches[pos % near_matches.len()] = last_seen[data[pos] as usize];
         last_seen[data[pos] as usize] = pos;
         if let Some(ref mut cb) = progress_cb {
             cb(pos + 1);
         }
     }
-    arrivals.remove(&data.len()).unwrap()[0].parse.clone()
+    let parse = arrivals[data.len()][0].parse;
+    workspace.retain(parse);
+    for arrival in arrivals[data.len()].drain(..) {
+        workspace.discard(arrival);
+    }
+    workspace.arrivals = arrivals;
+    parse
 }
 
 struct Config {
@@ -38,8 +38,17 @@ impl RansCoder {
         }
     }
 
-    pub fn finish(self) -> Vec<u8> {
-        let mut buffer = vec![];
+    /// Start a new stream, keeping the buffers of the previous one.
+    pub fn reset(&mut self, config: &Config) {
+        self.bits.clear();
+        self.use_bitstream = config.use_bitstream;
+        self.bitstream_is_big_endian = config.bitstream_is_big_endian;
+        self.invert_bit_encoding = config.invert_bit_encoding;
+    }
+
+    /// Write the encoded stream into `buffer`, replacing its contents.
+    pub fn finish_into(&mut self, buffer: &mut Vec<u8>) {
+        buffer.clear();
         let l_bits: u32 = if self.use_bitstream { 15 } else { 12 };
         let mut state = 1 << l_bits;
 
@@ -78,7 +87,7 @@ impl RansCoder {
 
         let num_flush_bits = if self.use_bitstream { 1 } else { 8 };
         let max_state_factor: u32 = 1 << (l_bits + num_flush_bits - PROB_BITS);
-        for step in self.bits.into_iter().rev() {
+        for &step in self.bits.iter().rev() {
             let prob = step as u32 & 32767;
             let (start, prob) = if step & 32768 != 0 {
                 (0, prob)
@@ -103,7 +112,7 @@ impl RansCoder {
         }
 
         buffer.reverse();
-        buffer
+        self.bits.clear();
     }
 }
 